@@ -0,0 +1,115 @@
+/**
+ * @file bench-compress.c
+ * @brief 上游消息压缩的CPU开销与节省字节数对比
+ *
+ * 对每个典型负载和压缩等级输出:
+ * - deflate:      压缩耗时和压缩后字节数
+ * - inflate_json: 流式解压并写入blob的耗时
+ * - plain_json:   未压缩时JSON写入blob的耗时, 作为解压开销的基线
+ *
+ * 用法: make bench-compress && ./bench-compress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <libubox/blobmsg.h>
+#include <libubox/blobmsg_json.h>
+#include "ubusd.h"
+#include "corpus.h"
+
+#define BENCH_MIN_NS 200000000ULL   // 每项至少运行200ms
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double bench_deflate(const struct bench_payload *p, int level, size_t *zlen) {
+    uint64_t iters = 0, start = now_ns(), elapsed;
+
+    do {
+        char *z = ubusd_deflate(p->json, p->len, level, zlen);
+        if (!z)
+            *zlen = p->len;
+        free(z);
+        iters++;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+
+    return (double)elapsed / iters;
+}
+
+static double bench_inflate(const char *z, size_t zlen) {
+    struct blob_buf bb;
+    uint64_t iters = 0, start = now_ns(), elapsed;
+
+    memset(&bb, 0, sizeof(bb));
+    do {
+        blob_buf_init(&bb, 0);
+        if (ubusd_inflate_json(&bb, z, zlen, NULL) != 0) {
+            fprintf(stderr, "inflate failed\n");
+            exit(EXIT_FAILURE);
+        }
+        iters++;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    blob_buf_free(&bb);
+
+    return (double)elapsed / iters;
+}
+
+static double bench_plain(const struct bench_payload *p) {
+    struct blob_buf bb;
+    uint64_t iters = 0, start = now_ns(), elapsed;
+
+    memset(&bb, 0, sizeof(bb));
+    do {
+        blob_buf_init(&bb, 0);
+        blobmsg_add_json_from_string(&bb, p->json);
+        iters++;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+    blob_buf_free(&bb);
+
+    return (double)elapsed / iters;
+}
+
+int main(void) {
+    static const int levels[] = { 1, 6, 9 };
+    size_t n = 0;
+    struct bench_payload *corpus = corpus_load(&n);
+
+    if (!corpus) {
+        fprintf(stderr, "cannot load corpus\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %-5s %-12s %12s %10s %10s %8s\n", "payload", "level", "op", "ns/op", "bytes", "out", "saved");
+
+    for (size_t i = 0; i < n; i++) {
+        const struct bench_payload *p = &corpus[i];
+
+        printf("%-8s %-5s %-12s %12.0f %10lu %10lu %7.1f%%\n", p->name, "-", "plain_json",
+            bench_plain(p), (unsigned long)p->len, (unsigned long)p->len, 0.0);
+
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            size_t zlen = 0;
+            double ns = bench_deflate(p, levels[l], &zlen);
+            double saved = 100.0 * (double)(p->len - zlen) / p->len;
+
+            printf("%-8s %-5d %-12s %12.0f %10lu %10lu %7.1f%%\n", p->name, levels[l], "deflate",
+                ns, (unsigned long)p->len, (unsigned long)zlen, saved);
+
+            char *z = ubusd_deflate(p->json, p->len, levels[l], &zlen);
+            if (!z)    // not compressible, peers receive plain JSON
+                continue;
+            printf("%-8s %-5d %-12s %12.0f %10lu %10lu %7.1f%%\n", p->name, levels[l], "inflate_json",
+                bench_inflate(z, zlen), (unsigned long)zlen, (unsigned long)p->len, saved);
+            free(z);
+        }
+    }
+
+    corpus_free(corpus, n);
+    return 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file bench-hotpath.c
+ * @brief ubus调用热路径的分阶段微基准测试
+ *
+ * 对每个典型负载分别测试ubus_handler中的各个阶段:
+ * - format_json:  blobmsg_format_json, ubus参数转JSON
+ * - build_req:    build_call_request, cJSON构造lua回调请求(含解析参数)
+ * - print_req:    cJSON_Print, 请求序列化
+ * - reply_json:   blobmsg_add_json_from_string, 响应转blob
+ * - type_lookup:  blogmsg_type, 配置中的参数类型查找
+ *
+ * 输出每次操作的耗时、内存分配次数和分配字节数, 格式固定, 可以直接diff不同提交的结果。
+ * 内存分配通过替换malloc统计, 仅支持glibc, 其他libc下分配计数显示为'-'。
+ *
+ * 用法: make bench-hotpath && ./bench-hotpath [-t MS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libubox/blobmsg.h>
+#include <libubox/blobmsg_json.h>
+#include <iot/cJSON.h>
+#include "ubusd.h"
+#include "corpus.h"
+
+static uint64_t s_allocs = 0;
+static uint64_t s_alloc_bytes = 0;
+
+#ifdef __GLIBC__
+#define ALLOC_COUNTING 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    s_allocs++;
+    s_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    s_allocs++;
+    s_alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    s_allocs++;
+    s_alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#else
+#define ALLOC_COUNTING 0
+#endif
+
+struct bench_result {
+    uint64_t iters;
+    uint64_t ns;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+};
+
+typedef void (*bench_fn)(void *arg);
+
+static uint64_t s_min_ns = 200000000ULL;   // 每项至少运行200ms
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(bench_fn fn, void *arg, struct bench_result *r) {
+    fn(arg);    // warm up
+
+    uint64_t allocs = s_allocs, alloc_bytes = s_alloc_bytes;
+    uint64_t start = now_ns(), elapsed;
+    r->iters = 0;
+    do {
+        fn(arg);
+        r->iters++;
+    } while ((elapsed = now_ns() - start) < s_min_ns);
+
+    r->ns = elapsed;
+    r->allocs = s_allocs - allocs;
+    r->alloc_bytes = s_alloc_bytes - alloc_bytes;
+}
+
+static void report(const char *stage, const char *payload, size_t bytes, const struct bench_result *r) {
+    printf("%-12s %-8s %8lu %12.1f", stage, payload, (unsigned long)bytes, (double)r->ns / r->iters);
+    if (ALLOC_COUNTING)
+        printf(" %10.2f %12.1f\n", (double)r->allocs / r->iters, (double)r->alloc_bytes / r->iters);
+    else
+        printf(" %10s %12s\n", "-", "-");
+}
+
+struct stage_arg {
+    const struct bench_payload *payload;
+    struct blob_buf msg;         /**< 负载对应的ubus参数 */
+    char *args;                  /**< blobmsg_format_json的结果 */
+    cJSON *request;              /**< build_call_request的结果 */
+    struct ubusd_option opts;
+};
+
+static void stage_format_json(void *arg) {
+    struct stage_arg *a = arg;
+    free(blobmsg_format_json(a->msg.head, true));
+}
+
+static void stage_build_req(void *arg) {
+    struct stage_arg *a = arg;
+    cJSON_Delete(build_call_request(&a->opts, "iot-ubusd-sample", "get", a->args));
+}
+
+static void stage_print_req(void *arg) {
+    struct stage_arg *a = arg;
+    free(cJSON_Print(a->request));
+}
+
+static void stage_reply_json(void *arg) {
+    struct stage_arg *a = arg;
+    struct blob_buf bb;
+
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+    blobmsg_add_json_from_string(&bb, a->payload->json);
+    blob_buf_free(&bb);
+}
+
+static void stage_type_lookup(void *arg) {
+    static const char *types[] = {
+        "BLOBMSG_TYPE_STRING", "BLOBMSG_TYPE_INT32", "BLOBMSG_TYPE_BOOL", "BLOBMSG_TYPE_TABLE",
+        "BLOBMSG_TYPE_ARRAY", "BLOBMSG_TYPE_UNSPEC", "BLOBMSG_TYPE_UNKNOWN",
+    };
+    volatile int sum = 0;
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+        sum += blogmsg_type(types[i]);
+    (void)arg;
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_result r;
+    size_t n = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            s_min_ns = strtoull(argv[++i], NULL, 10) * 1000000ULL;
+        } else {
+            fprintf(stderr, "Usage: %s [-t MS]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct bench_payload *corpus = corpus_load(&n);
+    if (!corpus) {
+        fprintf(stderr, "cannot load corpus\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-12s %-8s %8s %12s %10s %12s\n", "stage", "payload", "bytes", "ns/op", "allocs/op", "bytes/op");
+
+    for (size_t i = 0; i < n; i++) {
+        struct stage_arg a = {
+            .payload = &corpus[i],
+            .opts = { .module = "ubus/iot-ubusd", .func = "call" },
+        };
+
+        memset(&a.msg, 0, sizeof(a.msg));
+        blob_buf_init(&a.msg, 0);
+        if (!blobmsg_add_json_from_string(&a.msg, corpus[i].json)) {
+            fprintf(stderr, "invalid payload: %s\n", corpus[i].name);
+            return EXIT_FAILURE;
+        }
+        a.args = blobmsg_format_json(a.msg.head, true);
+        a.request = build_call_request(&a.opts, "iot-ubusd-sample", "get", a.args);
+
+        run(stage_format_json, &a, &r);
+        report("format_json", corpus[i].name, corpus[i].len, &r);
+        run(stage_build_req, &a, &r);
+        report("build_req", corpus[i].name, corpus[i].len, &r);
+        run(stage_print_req, &a, &r);
+        report("print_req", corpus[i].name, corpus[i].len, &r);
+        run(stage_reply_json, &a, &r);
+        report("reply_json", corpus[i].name, corpus[i].len, &r);
+
+        cJSON_Delete(a.request);
+        free(a.args);
+        blob_buf_free(&a.msg);
+    }
+
+    run(stage_type_lookup, NULL, &r);
+    report("type_lookup", "-", 0, &r);
+
+    corpus_free(corpus, n);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file corpus.c
+ * @brief 基准测试使用的典型JSON负载
+ *
+ * 负载内容固定生成, 保证不同提交之间的结果可以直接比较
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "corpus.h"
+
+struct sbuf {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static void sbuf_printf(struct sbuf *sb, const char *fmt, ...) {
+    va_list ap;
+
+    for (;;) {
+        size_t avail = sb->size - sb->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(sb->buf ? sb->buf + sb->len : NULL, avail, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < avail) {
+            sb->len += n;
+            return;
+        }
+        size_t size = sb->size ? sb->size * 2 : 1024;
+        while (size - sb->len <= (size_t)n)
+            size *= 2;
+        char *p = realloc(sb->buf, size);
+        if (!p)
+            return;
+        sb->buf = p;
+        sb->size = size;
+    }
+}
+
+static char *gen_small(size_t *len) {
+    struct sbuf sb = { 0 };
+
+    sbuf_printf(&sb, "{\"method\": \"get\", \"param\": {\"section\": \"lan\", \"option\": \"ipaddr\"}}");
+    *len = sb.len;
+    return sb.buf;
+}
+
+static char *gen_nested(size_t *len) {
+    static const char *types[] = { "interface", "device", "zone", "rule", "forwarding" };
+    struct sbuf sb = { 0 };
+
+    sbuf_printf(&sb, "{\"code\": 0, \"data\": {\"values\": {");
+    for (int i = 0; i < 40; i++) {
+        sbuf_printf(&sb, "%s\"cfg%06x\": {\".anonymous\": %s, \".type\": \"%s\", \".name\": \"cfg%06x\", "
+            "\".index\": %d, \"enabled\": \"1\", \"proto\": \"%s\", \"ipaddr\": \"192.168.%d.1\", "
+            "\"netmask\": \"255.255.255.0\", \"dns\": [\"8.8.8.8\", \"114.114.114.114\"], "
+            "\"options\": {\"mtu\": %d, \"metric\": %d, \"peerdns\": false, \"ip6assign\": 60}}",
+            i ? ", " : "", i * 0x1f3, i % 3 ? "true" : "false", types[i % 5], i * 0x1f3, i,
+            i % 2 ? "static" : "dhcp", i, 1500 - i, i * 10);
+    }
+    sbuf_printf(&sb, "}}}");
+    *len = sb.len;
+    return sb.buf;
+}
+
+static char *gen_array(size_t *len) {
+    struct sbuf sb = { 0 };
+
+    sbuf_printf(&sb, "{\"code\": 0, \"data\": {\"results\": [");
+    for (int i = 0; i < 120; i++) {
+        sbuf_printf(&sb, "%s{\"ssid\": \"AP-%04d\", \"bssid\": \"00:1A:2B:%02X:%02X:%02X\", \"mode\": \"Master\", "
+            "\"channel\": %d, \"signal\": %d, \"quality\": %d, \"quality_max\": 70, "
+            "\"encryption\": {\"enabled\": %s, \"wpa\": [2], \"authentication\": [\"psk\"], \"ciphers\": [\"ccmp\"]}}",
+            i ? ", " : "", i * 37 % 10000, i, (i * 7) & 0xff, (i * 13) & 0xff,
+            1 + i % 13, -40 - i % 50, 70 - i % 50, i % 4 ? "true" : "false");
+    }
+    sbuf_printf(&sb, "]}}");
+    *len = sb.len;
+    return sb.buf;
+}
+
+struct bench_payload *corpus_load(size_t *n) {
+    struct bench_payload *corpus = calloc(3, sizeof(struct bench_payload));
+    if (!corpus)
+        return NULL;
+
+    corpus[0].name = "small";
+    corpus[0].json = gen_small(&corpus[0].len);
+    corpus[1].name = "nested";
+    corpus[1].json = gen_nested(&corpus[1].len);
+    corpus[2].name = "array";
+    corpus[2].json = gen_array(&corpus[2].len);
+
+    *n = 3;
+    return corpus;
+}
+
+void corpus_free(struct bench_payload *corpus, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        free(corpus[i].json);
+    free(corpus);
+}
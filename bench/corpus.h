@@ -0,0 +1,36 @@
+/**
+ * @file corpus.h
+ * @brief 基准测试使用的典型JSON负载
+ */
+
+#ifndef __IOT_UBUSD_BENCH_CORPUS_H__
+#define __IOT_UBUSD_BENCH_CORPUS_H__
+
+#include <stddef.h>
+
+/**
+ * @brief 基准测试负载
+ */
+struct bench_payload {
+    const char *name;    /**< 负载名称 */
+    char *json;          /**< JSON对象文本 */
+    size_t len;          /**< 文本长度 */
+};
+
+/**
+ * @brief 生成基准测试负载
+ * @param n 返回负载个数
+ * @return 负载数组, 使用corpus_free释放
+ *
+ * small:  单个简单调用参数
+ * nested: 多层嵌套的配置导出
+ * array:  大数组, 如无线扫描结果
+ */
+struct bench_payload *corpus_load(size_t *n);
+
+/**
+ * @brief 释放基准测试负载
+ */
+void corpus_free(struct bench_payload *corpus, size_t n);
+
+#endif //__IOT_UBUSD_BENCH_CORPUS_H__
@@ -0,0 +1,167 @@
+/**
+ * @file capture.c
+ * @brief ubus调用抓包, 用于在其他设备上回放真实负载
+ *
+ * 每个ubus调用在响应后追加一条记录, 格式见capture.h;
+ * 文件超过-W指定的长度后轮转为.1文件, 避免在设备的tmpfs上无限增长
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <iot/mongoose.h>
+#include "ubusd.h"
+#include "capture.h"
+
+/**
+ * @brief 打开抓包文件, 新文件写入文件头
+ * @param cap 抓包文件
+ * @return 0表示成功, -1表示失败
+ */
+static int capture_reopen(struct ubusd_capture *cap) {
+    struct stat st;
+    uint8_t hdr[UBUSD_CAPTURE_HDR_SIZE];
+
+    int fd = open(cap->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        MG_ERROR(("cannot open capture file %s: %s", cap->path, strerror(errno)));
+        return -1;
+    }
+
+    cap->size = 0;
+    if (fstat(fd, &st) == 0)
+        cap->size = (size_t)st.st_size;
+
+    if (cap->size == 0) {
+        memcpy(hdr, UBUSD_CAPTURE_MAGIC, 4);
+        capture_put_le32(hdr + 4, UBUSD_CAPTURE_VERSION);
+        if (write(fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+            MG_ERROR(("cannot write capture file %s: %s", cap->path, strerror(errno)));
+            close(fd);
+            return -1;
+        }
+        cap->size = sizeof(hdr);
+    }
+
+    cap->fd = fd;
+    return 0;
+}
+
+/**
+ * @brief 当前文件改名为path.1后重新打开, 最多保留两个文件
+ * @param cap 抓包文件
+ */
+static void capture_rotate(struct ubusd_capture *cap) {
+    char *old = mg_mprintf("%s.1", cap->path);
+
+    close(cap->fd);
+    cap->fd = -1;
+
+    if (old && rename(cap->path, old) != 0)
+        MG_ERROR(("cannot rotate capture file %s: %s", cap->path, strerror(errno)));
+    free(old);
+
+    if (capture_reopen(cap) != 0)
+        MG_ERROR(("capture stopped"));
+}
+
+/**
+ * @brief 打开抓包文件, 新文件写入文件头
+ * @param cap 抓包文件
+ * @param path 抓包文件路径
+ * @param max_size 文件最大长度, 超过后轮转为path.1, 0表示不限制
+ * @return 0表示成功, -1表示失败
+ */
+int ubusd_capture_open(struct ubusd_capture *cap, const char *path, size_t max_size) {
+    cap->fd = -1;
+    cap->path = path;
+    cap->max_size = max_size;
+
+    if (capture_reopen(cap) != 0)
+        return -1;
+
+    MG_INFO(("capture ubus calls to: %s, max size: %lu", path, (unsigned long)max_size));
+    return 0;
+}
+
+/**
+ * @brief 关闭抓包文件
+ * @param cap 抓包文件
+ */
+void ubusd_capture_close(struct ubusd_capture *cap) {
+    if (cap->fd >= 0)
+        close(cap->fd);
+    cap->fd = -1;
+}
+
+/**
+ * @brief 获取单调时钟, 用于计算调用耗时
+ * @return 微秒
+ */
+uint64_t ubusd_capture_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 追加一条调用记录
+ * @param cap 抓包文件
+ * @param start 调用开始时间, ubusd_capture_clock返回值
+ * @param object 对象名
+ * @param method 方法名
+ * @param args JSON格式的调用参数, 可以为NULL
+ * @param response_len 响应长度, 压缩响应为解压后的长度
+ * @param limited 调用是否被限流拒绝
+ *
+ * 整条记录一次write写入, O_APPEND保证记录不会交错;
+ * 写入后超过max_size时先轮转文件
+ */
+void ubusd_capture_record(struct ubusd_capture *cap, uint64_t start, const char *object, const char *method,
+                          const char *args, size_t response_len, int limited) {
+    struct timespec ts;
+    uint64_t latency = ubusd_capture_clock() - start;
+    size_t object_len = strlen(object);
+    size_t method_len = strlen(method);
+    size_t args_len = args ? strlen(args) : 0;
+
+    if (object_len > UINT16_MAX || method_len > UINT16_MAX || args_len > UINT32_MAX)
+        return;
+
+    size_t len = UBUSD_CAPTURE_REC_SIZE + object_len + method_len + args_len;
+    if (cap->max_size && cap->size > UBUSD_CAPTURE_HDR_SIZE && cap->size + len > cap->max_size)
+        capture_rotate(cap);
+    if (cap->fd < 0)
+        return;
+
+    uint8_t *rec = malloc(len);
+    if (!rec)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    capture_put_le64(rec, start);
+    capture_put_le64(rec + 8, now - latency);
+    capture_put_le32(rec + 16, latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency);
+    capture_put_le32(rec + 20, response_len > UINT32_MAX ? UINT32_MAX : (uint32_t)response_len);
+    capture_put_le32(rec + 24, (uint32_t)args_len);
+    capture_put_le32(rec + 28, limited ? UBUSD_CAPTURE_F_LIMITED : 0);
+    capture_put_le16(rec + 32, (uint16_t)object_len);
+    capture_put_le16(rec + 34, (uint16_t)method_len);
+
+    uint8_t *p = rec + UBUSD_CAPTURE_REC_SIZE;
+    memcpy(p, object, object_len);
+    p += object_len;
+    memcpy(p, method, method_len);
+    p += method_len;
+    if (args_len)
+        memcpy(p, args, args_len);
+
+    if (write(cap->fd, rec, len) != (ssize_t)len)
+        MG_ERROR(("write capture record: %s", strerror(errno)));
+    else
+        cap->size += len;
+
+    free(rec);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file capture.h
+ * @brief ubus调用抓包文件格式
+ *
+ * 文件头: 4字节魔数"IUBC" + 4字节版本号
+ * 每条记录: 36字节固定部分 + 对象名 + 方法名 + 调用参数(JSON文本), 无填充
+ *   0  u64 调用开始时间, 微秒, CLOCK_MONOTONIC, 用于计算调用间隔
+ *   8  u64 调用开始时间, 微秒, CLOCK_REALTIME, 仅作为标签显示, 可能随校时跳变
+ *  16  u32 处理耗时, 微秒
+ *  20  u32 响应长度, 压缩响应为解压后的长度
+ *  24  u32 参数长度
+ *  28  u32 标志位, UBUSD_CAPTURE_F_*; 限流记录不含调用参数, 参数长度为0
+ *  32  u16 对象名长度
+ *  34  u16 方法名长度
+ * 所有整数均为小端序, 便于在设备上抓包后在其他架构上回放。
+ * 单调时钟在重启后从头计数, 同一文件中跨重启的记录间隔可能为负, 回放时需要限制
+ */
+
+#ifndef __IOT_UBUSD_CAPTURE_H__
+#define __IOT_UBUSD_CAPTURE_H__
+
+#include <stdint.h>
+
+#define UBUSD_CAPTURE_MAGIC "IUBC"
+#define UBUSD_CAPTURE_VERSION 2
+#define UBUSD_CAPTURE_HDR_SIZE 8
+#define UBUSD_CAPTURE_REC_SIZE 36
+
+#define UBUSD_CAPTURE_F_LIMITED 0x1    /**< 调用被限流拒绝, 未转发给iot-rpcd */
+
+static inline void capture_put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void capture_put_le32(uint8_t *p, uint32_t v) {
+    capture_put_le16(p, (uint16_t)v);
+    capture_put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline void capture_put_le64(uint8_t *p, uint64_t v) {
+    capture_put_le32(p, (uint32_t)v);
+    capture_put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t capture_get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t capture_get_le32(const uint8_t *p) {
+    return capture_get_le16(p) | ((uint32_t)capture_get_le16(p + 2) << 16);
+}
+
+static inline uint64_t capture_get_le64(const uint8_t *p) {
+    return capture_get_le32(p) | ((uint64_t)capture_get_le32(p + 4) << 32);
+}
+
+#endif //__IOT_UBUSD_CAPTURE_H__
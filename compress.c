@@ -0,0 +1,104 @@
+/**
+ * @file compress.c
+ * @brief 上游消息的zlib压缩和解压
+ *
+ * 超过阈值的请求以zlib流(RFC 1950)发送, 不再是JSON文本。
+ * 压缩消息由传输层在信封中显式标记, 对端不需要根据内容猜测:
+ * - mqtt: 发布到原主题加"/zlib"后缀的主题
+ * - unix: 帧头长度字段的最高位置1
+ */
+
+#include <zlib.h>
+#include <libubox/blobmsg.h>
+#include <libubox/blobmsg_json.h>
+#include <iot/mongoose.h>
+#include "ubusd.h"
+
+#define INFLATE_CHUNK_SIZE 4096
+#define INFLATE_MAX_SIZE (4 * 1024 * 1024)   // 解压后最大长度, 防止小的压缩消息展开成超大的JSON
+
+/**
+ * @brief 压缩消息
+ * @param data 消息内容
+ * @param len 消息长度
+ * @param level zlib压缩等级
+ * @param out_len 返回压缩后长度
+ * @return 压缩后的消息, 需要free; 失败或压缩后不更小时返回NULL
+ */
+char *ubusd_deflate(const char *data, size_t len, int level, size_t *out_len) {
+    uLongf zlen = compressBound(len);
+    char *out = malloc(zlen);
+    if (!out)
+        return NULL;
+
+    if (compress2((Bytef *)out, &zlen, (const Bytef *)data, len, level) != Z_OK || zlen >= len) {
+        free(out);
+        return NULL;
+    }
+
+    *out_len = zlen;
+    return out;
+}
+
+/**
+ * @brief 解压JSON消息并直接写入blob
+ * @param bb blob缓冲区
+ * @param data 压缩消息
+ * @param len 压缩消息长度
+ * @param plain_len 返回解压后长度, 可以为NULL
+ * @return 0表示成功, -1表示失败
+ *
+ * 解压输出按块送入json-c解析器, 不生成完整的解压文本;
+ * 解压后超过INFLATE_MAX_SIZE时停止并返回失败
+ */
+int ubusd_inflate_json(struct blob_buf *bb, const char *data, size_t len, size_t *plain_len) {
+    char chunk[INFLATE_CHUNK_SIZE];
+    z_stream zs;
+    json_object *obj = NULL;
+    int ret = Z_OK;
+
+    struct json_tokener *tok = json_tokener_new();
+    if (!tok)
+        return -1;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        json_tokener_free(tok);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+
+    while (ret == Z_OK) {
+        zs.next_out = (Bytef *)chunk;
+        zs.avail_out = sizeof(chunk);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+            break;
+        if (zs.total_out > INFLATE_MAX_SIZE) {
+            MG_ERROR(("inflated response exceeds %d bytes", INFLATE_MAX_SIZE));
+            ret = Z_DATA_ERROR;
+            break;
+        }
+
+        size_t n = sizeof(chunk) - zs.avail_out;
+        if (n > 0 && !obj) {
+            obj = json_tokener_parse_ex(tok, chunk, (int)n);
+            if (!obj && json_tokener_get_error(tok) != json_tokener_continue)
+                break;
+        }
+    }
+
+    int ok = ret == Z_STREAM_END && obj && json_object_get_type(obj) == json_type_object &&
+             blobmsg_add_object(bb, obj);
+
+    if (plain_len)
+        *plain_len = zs.total_out;
+    if (obj)
+        json_object_put(obj);
+    inflateEnd(&zs);
+    json_tokener_free(tok);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file ipc.c
+ * @brief 经unix套接字直连iot-rpcd的上游传输层
+ *
+ * 与mqtt传输相比省去了本地mqtt服务的转发, 帧格式为:
+ * 4字节大端长度 + 4字节大端请求id + 消息内容(与mqtt消息内容相同, JSON文本或zlib压缩消息)
+ * 长度字段的最高位为压缩标记, 置1表示消息内容为zlib压缩消息;
+ * 响应帧带回请求帧的id, 超时后迟到的响应不会被当作下一个请求的响应
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <iot/mongoose.h>
+#include <iot/iot.h>
+#include "ubusd.h"
+
+#define IPC_RECONNECT_INTERVAL 2000         // 重连间隔, 2S
+#define IPC_FRAME_HDR_SIZE 8                // 帧头长度
+#define IPC_FRAME_MAX_SIZE (16 * 1024 * 1024) // 单帧最大长度
+#define IPC_FRAME_COMPRESSED 0x80000000U    // 帧头压缩标记
+
+struct ipc_conn {
+    int fd;
+    uint64_t connect_active;  /**< 上次尝试连接时间 */
+
+    char *tx;                 /**< 待发送帧 */
+    size_t tx_len;
+    size_t tx_sent;
+
+    char *rx;                 /**< 接收缓冲区 */
+    size_t rx_len;
+    size_t rx_size;
+};
+
+static void ipc_close(struct ipc_conn *conn) {
+    if (conn->fd >= 0) {
+        MG_INFO(("ipc connection closed"));
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    if (conn->tx)
+        MG_ERROR(("ipc connection lost, drop unsent request"));
+    free(conn->tx);
+    conn->tx = NULL;
+    conn->tx_len = conn->tx_sent = 0;
+    conn->rx_len = 0;
+}
+
+static void ipc_connect(struct ubusd_private *priv, struct ipc_conn *conn) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const char *path = priv->cfg.opts->ipc_path;
+    uint64_t now = mg_millis();
+
+    if (conn->connect_active && now - conn->connect_active < IPC_RECONNECT_INTERVAL)
+        return;
+    conn->connect_active = now;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        MG_ERROR(("ipc path too long: %s", path));
+        return;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        MG_ERROR(("ipc socket: %s", strerror(errno)));
+        return;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        MG_DEBUG(("ipc connect %s: %s", path, strerror(errno)));
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    conn->fd = fd;
+    MG_INFO(("connect to iot-rpcd: %s", path));
+}
+
+static void ipc_put_be32(char *p, uint32_t v) {
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+static uint32_t ipc_get_be32(const char *data) {
+    const uint8_t *p = (const uint8_t *)data;
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief 取出request槽中的请求并组帧
+ */
+static void ipc_take_request(struct ubusd_private *priv, struct ipc_conn *conn) {
+    size_t len = priv->request_len;
+    uint32_t hdr = (uint32_t)len | (priv->request_compressed ? IPC_FRAME_COMPRESSED : 0);
+
+    conn->tx = malloc(IPC_FRAME_HDR_SIZE + len);
+    if (conn->tx) {
+        ipc_put_be32(conn->tx, hdr);
+        ipc_put_be32(conn->tx + 4, priv->request_id);
+        memcpy(conn->tx + IPC_FRAME_HDR_SIZE, priv->request, len);
+        conn->tx_len = IPC_FRAME_HDR_SIZE + len;
+        conn->tx_sent = 0;
+    }
+
+    ubusd_request_release(priv);
+}
+
+static int ipc_write(struct ipc_conn *conn) {
+    while (conn->tx_sent < conn->tx_len) {
+        ssize_t n = send(conn->fd, conn->tx + conn->tx_sent, conn->tx_len - conn->tx_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+            MG_ERROR(("ipc send: %s", strerror(errno)));
+            return -1;
+        }
+        conn->tx_sent += n;
+    }
+
+    free(conn->tx);
+    conn->tx = NULL;
+    conn->tx_len = conn->tx_sent = 0;
+    return 0;
+}
+
+/**
+ * @brief 从接收缓冲区解析完整帧, 放入response槽
+ */
+static int ipc_parse(struct ubusd_private *priv, struct ipc_conn *conn) {
+    while (conn->rx_len >= IPC_FRAME_HDR_SIZE) {
+        uint32_t hdr = ipc_get_be32(conn->rx);
+        size_t len = hdr & ~IPC_FRAME_COMPRESSED;
+        if (len > IPC_FRAME_MAX_SIZE) {
+            MG_ERROR(("ipc frame too large: %lu", (unsigned long)len));
+            return -1;
+        }
+        if (conn->rx_len < IPC_FRAME_HDR_SIZE + len)
+            break;
+
+        MG_DEBUG(("received %lu bytes", (unsigned long)len));
+
+        // handle msg, compressed when the frame header is flagged
+        if ( !priv->response_full ) {
+            priv->response = malloc(len + 1);
+            if (priv->response) {
+                memcpy(priv->response, conn->rx + IPC_FRAME_HDR_SIZE, len);
+                priv->response[len] = '\0';
+                priv->response_len = len;
+                priv->response_id = ipc_get_be32(conn->rx + 4);
+                priv->response_compressed = (hdr & IPC_FRAME_COMPRESSED) != 0;
+                __sync_synchronize();
+                priv->response_full = 1;
+            }
+        }
+
+        conn->rx_len -= IPC_FRAME_HDR_SIZE + len;
+        memmove(conn->rx, conn->rx + IPC_FRAME_HDR_SIZE + len, conn->rx_len);
+    }
+    return 0;
+}
+
+static int ipc_read(struct ubusd_private *priv, struct ipc_conn *conn) {
+    for (;;) {
+        if (conn->rx_size - conn->rx_len < 1024) {
+            size_t size = conn->rx_size ? conn->rx_size * 2 : 4096;
+            char *rx = realloc(conn->rx, size);
+            if (!rx)
+                return -1;
+            conn->rx = rx;
+            conn->rx_size = size;
+        }
+
+        ssize_t n = recv(conn->fd, conn->rx + conn->rx_len, conn->rx_size - conn->rx_len, 0);
+        if (n == 0) {
+            return -1;
+        } else if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            MG_ERROR(("ipc recv: %s", strerror(errno)));
+            return -1;
+        }
+        conn->rx_len += n;
+    }
+
+    return ipc_parse(priv, conn);
+}
+
+static void ipc_start(struct ubusd_private *priv) {
+    struct ipc_conn *conn = calloc(1, sizeof(struct ipc_conn));
+    if (!conn) {
+        MG_ERROR(("ipc transport: out of memory"));
+        return;
+    }
+    conn->fd = -1;
+    priv->transport_data = conn;
+}
+
+static void ipc_poll(struct ubusd_private *priv) {
+    struct ipc_conn *conn = (struct ipc_conn *)priv->transport_data;
+
+    if (conn && conn->fd < 0)
+        ipc_connect(priv, conn);
+
+    if (!conn || conn->fd < 0) {
+        if (priv->request_full == 1 && ubusd_request_claim(priv)) {
+            MG_ERROR(("iot-rpcd not connected, drop request %u", priv->request_id));
+            ubusd_request_release(priv);
+        }
+        usleep(10000);
+        return;
+    }
+
+    if (!conn->tx && priv->request_full == 1 && ubusd_request_claim(priv))
+        ipc_take_request(priv, conn);
+
+    struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+    if (conn->tx)
+        pfd.events |= POLLOUT;
+
+    if (poll(&pfd, 1, 10) <= 0)
+        return;
+
+    if ((pfd.revents & POLLOUT) && ipc_write(conn) != 0) {
+        ipc_close(conn);
+        return;
+    }
+
+    if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && ipc_read(priv, conn) != 0)
+        ipc_close(conn);
+}
+
+static void ipc_stop(struct ubusd_private *priv) {
+    struct ipc_conn *conn = (struct ipc_conn *)priv->transport_data;
+
+    if (!conn)
+        return;
+    ipc_close(conn);
+    free(conn->rx);
+    free(conn);
+    priv->transport_data = NULL;
+}
+
+struct ubusd_transport ipc_transport = {
+    .name = "unix",
+    .start = ipc_start,
+    .poll = ipc_poll,
+    .stop = ipc_stop,
+};
@@ -15,6 +15,9 @@
 /* ubus对象配置文件默认路径 */
 #define UBUS_OBJECT_CONFIG_FILE "/www/iot/etc/iot-ubusd.json"
 
+/* iot-rpcd unix套接字默认路径 */
+#define IOT_RPCD_IPC_PATH "/var/run/iot-rpcd.sock"
+
 /**
  * @brief 打印程序使用帮助信息
  * @param prog 程序名称
@@ -25,13 +28,21 @@ static void usage(const char *prog, struct ubusd_option *default_opts) {
     fprintf(stderr,
         "IoT-SDK v.%s\n"
         "Usage: %s OPTIONS\n"
+        "  -t NAME   - upstream transport, 'mqtt' or 'unix', default: '%s'\n"
+        "  -u PATH   - iot-rpcd unix socket path, default: '%s'\n"
         "  -s ADDR   - local mqtt server address, default: '%s'\n"
         "  -a n      - local mqtt keeplive, default: '%d'\n"
+        "  -q n      - local mqtt response subscription qos, default: '%d'\n"
         "  -c PATH  - ubusd object config, default: '%s'\n"
         "  -m PATH  - iot-ubusd lua callback script path, default: '%s'\n"
         "  -f NAME  - iot-ubusd lua callback script entrypoint, default: '%s'\n"
+        "  -r n     - requests per second allowed per ubus peer, 0 for unlimited, default: %d\n"
+        "  -b n     - request burst allowed per ubus peer, default: %d\n"
+        "  -z n     - compress upstream requests larger than n bytes, 0 to disable, default: %d\n"
+        "  -w PATH  - append every ubus call to capture file, default: none\n"
+        "  -W n     - rotate capture file to PATH.1 when it exceeds n bytes, 0 for unlimited, default: %d\n"
         "  -v LEVEL - debug level, from 0 to 4, default: %d\n",
-        MG_VERSION, prog, opts->mqtt_serve_address, opts->mqtt_keepalive, opts->ubus_obj_cfg_file, opts->module, opts->func, opts->debug_level);
+        MG_VERSION, prog, opts->transport, opts->ipc_path, opts->mqtt_serve_address, opts->mqtt_keepalive, opts->mqtt_sub_qos, opts->ubus_obj_cfg_file, opts->module, opts->func, opts->peer_rate, opts->peer_burst, opts->compress_threshold, opts->capture_max_size, opts->debug_level);
 
     exit(EXIT_FAILURE);
 }
@@ -49,13 +60,44 @@ static void usage(const char *prog, struct ubusd_option *default_opts) {
 static void parse_args(int argc, char *argv[], struct ubusd_option *opts) {
     // Parse command-line flags
     for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-s") == 0) {
+        if (strcmp(argv[i], "-t") == 0) {
+            opts->transport = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            opts->ipc_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
             opts->mqtt_serve_address = argv[++i];
         } else if (strcmp(argv[i], "-a") == 0) {
             opts->mqtt_keepalive = atoi(argv[++i]);
             if (opts->mqtt_keepalive < 6) {
                 opts->mqtt_keepalive = 6;
             }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            opts->mqtt_sub_qos = atoi(argv[++i]);
+            if (opts->mqtt_sub_qos < 0 || opts->mqtt_sub_qos > 2) {
+                opts->mqtt_sub_qos = MQTT_QOS;
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            opts->peer_rate = atoi(argv[++i]);
+            if (opts->peer_rate < 0) {
+                opts->peer_rate = 0;
+            }
+        } else if (strcmp(argv[i], "-b") == 0) {
+            opts->peer_burst = atoi(argv[++i]);
+            if (opts->peer_burst < 1) {
+                opts->peer_burst = 1;
+            }
+        } else if (strcmp(argv[i], "-z") == 0) {
+            opts->compress_threshold = atoi(argv[++i]);
+            if (opts->compress_threshold < 0) {
+                opts->compress_threshold = 0;
+            }
+        } else if (strcmp(argv[i], "-w") == 0) {
+            opts->capture_file = argv[++i];
+        } else if (strcmp(argv[i], "-W") == 0) {
+            opts->capture_max_size = atoi(argv[++i]);
+            if (opts->capture_max_size < 0) {
+                opts->capture_max_size = 0;
+            }
         } else if (strcmp(argv[i], "-v") == 0) {
             opts->debug_level = atoi(argv[++i]);
         } else if( strcmp(argv[i], "-c") == 0) {
@@ -81,16 +123,29 @@ int main(int argc, char *argv[]) {
     struct ubusd_option opts = {
         .debug_level = MG_LL_INFO,
         .ubus_obj_cfg_file = UBUS_OBJECT_CONFIG_FILE,
+        .transport = "mqtt",
+        .ipc_path = IOT_RPCD_IPC_PATH,
         .mqtt_serve_address = MQTT_LISTEN_ADDR,
         .mqtt_keepalive = 6,
+        .mqtt_sub_qos = MQTT_QOS,
         .module = "ubus/iot-ubusd",
         .func = "call",
+        .peer_rate = 0,
+        .peer_burst = 10,
+        .compress_threshold = 0,
+        .capture_max_size = 1024 * 1024,
     };
 
     parse_args(argc, argv, &opts);
 
     MG_INFO(("IoT-SDK version         : v%s", MG_VERSION));
     MG_INFO(("Ubus object config file : %s", opts.ubus_obj_cfg_file));
+    MG_INFO(("Upstream transport      : %s", opts.transport));
+    if (opts.compress_threshold > 0) {
+        MG_INFO(("Compress threshold      : %d", opts.compress_threshold));
+        MG_ERROR(("-z requires iot-rpcd support for zlib marked messages (mqtt '/zlib' topic or unix frame flag), "
+                  "otherwise requests over %d bytes are never answered", opts.compress_threshold));
+    }
 
     ubusd_main(&opts);
 
@@ -4,6 +4,9 @@
 
 #define IOT_UBUSD_PUB_TOPIC "mg/iot-ubusd/channel/iot-rpcd"
 #define IOT_UBUSD_SUB_TOPIC "mg/iot-ubusd/channel"
+#define IOT_UBUSD_ZLIB_SUFFIX "/zlib"   // zlib压缩消息的主题后缀
+
+static uint32_t s_published_id = 0;     // 最近发布的请求id, mqtt消息不带id, 响应按此匹配
 
 static void mqtt_ev_open_cb(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
     MG_INFO(("mqtt client connection created"));
@@ -28,17 +31,16 @@ static void mqtt_ev_poll_cb(struct mg_connection *c, int ev, void *ev_data, void
         c->is_draining = 1;
     }
 
-    if (priv->request_full) {
-        struct mg_str pubt = mg_str(IOT_UBUSD_PUB_TOPIC);
+    if (priv->request_full == 1 && ubusd_request_claim(priv)) {
+        struct mg_str pubt = mg_str(priv->request_compressed ?
+            IOT_UBUSD_PUB_TOPIC IOT_UBUSD_ZLIB_SUFFIX : IOT_UBUSD_PUB_TOPIC);
         struct mg_mqtt_opts pub_opts = {0};
         pub_opts.topic = pubt;
-        pub_opts.message = mg_str(priv->request);
-        pub_opts.qos = MQTT_QOS, pub_opts.retain = false;
+        pub_opts.message = mg_str_n(priv->request, priv->request_len);
+        pub_opts.qos = priv->request_qos, pub_opts.retain = false;
         mg_mqtt_pub(c, &pub_opts);
-        free(priv->request);
-        priv->request = NULL;
-        __sync_synchronize();
-        priv->request_full = 0;
+        s_published_id = priv->request_id;
+        ubusd_request_release(priv);
     }
 
 }
@@ -54,16 +56,19 @@ static void mqtt_ev_close_cb(struct mg_connection *c, int ev, void *ev_data, voi
 
 static void mqtt_ev_mqtt_open_cb(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
 
-    struct mg_str subt = mg_str(IOT_UBUSD_SUB_TOPIC);
+    static const char *topics[] = { IOT_UBUSD_SUB_TOPIC, IOT_UBUSD_SUB_TOPIC IOT_UBUSD_ZLIB_SUFFIX };
 
     struct ubusd_private *priv = (struct ubusd_private*)c->mgr->userdata;
 
     MG_INFO(("connect to mqtt server: %s", priv->cfg.opts->mqtt_serve_address));
-    struct mg_mqtt_opts sub_opts = {0};
-    sub_opts.topic = subt;
-    sub_opts.qos = MQTT_QOS;
-    mg_mqtt_sub(c, &sub_opts);
-    MG_INFO(("subscribed to %.*s", (int) subt.len, subt.ptr));
+    for (size_t i = 0; i < sizeof(topics) / sizeof(topics[0]); i++) {
+        struct mg_str subt = mg_str(topics[i]);
+        struct mg_mqtt_opts sub_opts = {0};
+        sub_opts.topic = subt;
+        sub_opts.qos = priv->cfg.opts->mqtt_sub_qos;
+        mg_mqtt_sub(c, &sub_opts);
+        MG_INFO(("subscribed to %.*s, qos: %d", (int) subt.len, subt.ptr, sub_opts.qos));
+    }
 
 }
 
@@ -82,14 +87,22 @@ static void mqtt_ev_mqtt_msg_cb(struct mg_connection *c, int ev, void *ev_data,
     struct mg_mqtt_message *mm = (struct mg_mqtt_message *) ev_data;
     struct ubusd_private *priv = (struct ubusd_private*)c->mgr->userdata;
 
-    MG_DEBUG(("received %.*s <- %.*s", (int) mm->data.len, mm->data.ptr,
+    MG_DEBUG(("received %lu bytes <- %.*s", (unsigned long) mm->data.len,
         (int) mm->topic.len, mm->topic.ptr));
 
-    // handle msg
+    // handle msg, compressed when received on the zlib topic
     if ( !priv->response_full ) {
-        priv->response = mg_mprintf("%.*s", (int) mm->data.len, mm->data.ptr);
-        __sync_synchronize();
-        priv->response_full = 1;
+        priv->response = malloc(mm->data.len + 1);
+        if (priv->response) {
+            memcpy(priv->response, mm->data.ptr, mm->data.len);
+            priv->response[mm->data.len] = '\0';
+            priv->response_len = mm->data.len;
+            priv->response_id = s_published_id;
+            priv->response_compressed =
+                mg_strcmp(mm->topic, mg_str(IOT_UBUSD_SUB_TOPIC IOT_UBUSD_ZLIB_SUFFIX)) == 0;
+            __sync_synchronize();
+            priv->response_full = 1;
+        }
     }
 }
 
@@ -128,7 +141,7 @@ static void mqtt_cb(struct mg_connection *c, int ev, void *ev_data, void *fn_dat
 
 
 // Timer function - recreate client connection if it is closed
-void timer_mqtt_fn(void *arg) {
+static void timer_mqtt_fn(void *arg) {
     struct mg_mgr *mgr = (struct mg_mgr *)arg;
     struct ubusd_private *priv = (struct ubusd_private*)mgr->userdata;
     uint64_t now = mg_millis();
@@ -157,4 +170,19 @@ void timer_mqtt_fn(void *arg) {
             priv->ping_active = now;
         }
     }
-}
\ No newline at end of file
+}
+
+static void mqtt_start(struct ubusd_private *priv) {
+    int timer_opts = MG_TIMER_REPEAT | MG_TIMER_RUN_NOW;
+    mg_timer_add(&priv->mgr, 2000, timer_opts, timer_mqtt_fn, &priv->mgr);
+}
+
+static void mqtt_poll(struct ubusd_private *priv) {
+    mg_mgr_poll(&priv->mgr, 10);
+}
+
+struct ubusd_transport mqtt_transport = {
+    .name = "mqtt",
+    .start = mqtt_start,
+    .poll = mqtt_poll,
+};
@@ -0,0 +1,61 @@
+/**
+ * @file request.c
+ * @brief ubus调用与iot-rpcd请求之间的转换
+ *
+ * 与ubusd运行状态无关的转换函数, 便于基准测试单独链接
+ */
+
+#include <libubox/blobmsg.h>
+#include <iot/cJSON.h>
+#include <iot/iot.h>
+#include "ubusd.h"
+
+/**
+ * @brief 构造调用lua回调脚本的iot-rpcd请求
+ * @param opts 配置选项
+ * @param object 对象名
+ * @param method 方法名
+ * @param args JSON格式的调用参数
+ * @return 请求JSON对象, 需要cJSON_Delete释放
+ */
+cJSON *build_call_request(struct ubusd_option *opts, const char *object, const char *method, const char *args) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, FIELD_METHOD, "call");
+
+    cJSON *param = cJSON_CreateArray();
+    cJSON_AddItemToArray(param, cJSON_CreateString(opts->module));
+    cJSON_AddItemToArray(param, cJSON_CreateString(opts->func));
+
+    cJSON *call_args = cJSON_CreateObject();
+    cJSON_AddItemToObject(call_args, "object", cJSON_CreateString(object));
+    cJSON_AddItemToObject(call_args, "method", cJSON_CreateString(method));
+    cJSON *data_obj = cJSON_Parse(args);
+    cJSON_AddItemToObject(call_args, FIELD_DATA, data_obj);
+    cJSON_AddItemToArray(param, call_args);
+
+    cJSON_AddItemToObject(root, FIELD_PARAM, param);
+    return root;
+}
+
+/**
+ * @brief 将字符串类型转换为blobmsg类型
+ * @param type 类型字符串
+ * @return blobmsg类型枚举值
+ */
+int blogmsg_type(const char *type) {
+    if (strcmp(type, "BLOBMSG_TYPE_STRING") == 0) {
+        return BLOBMSG_TYPE_STRING;
+    } else if (strcmp(type, "BLOBMSG_TYPE_INT32") == 0) {
+        return BLOBMSG_TYPE_INT32;
+    } else if (strcmp(type, "BLOBMSG_TYPE_BOOL") == 0) {
+        return BLOBMSG_TYPE_BOOL;
+    } else if (strcmp(type, "BLOBMSG_TYPE_TABLE") == 0) {
+        return BLOBMSG_TYPE_TABLE;
+    } else if (strcmp(type, "BLOBMSG_TYPE_ARRAY") == 0) {
+        return BLOBMSG_TYPE_ARRAY;
+    } else if (strcmp(type, "BLOBMSG_TYPE_UNSPEC") == 0) {
+        return BLOBMSG_TYPE_UNSPEC;
+    } else {
+        return BLOBMSG_TYPE_UNSPEC;
+    }
+}
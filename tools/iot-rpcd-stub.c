@@ -0,0 +1,426 @@
+/**
+ * @file iot-rpcd-stub.c
+ * @brief iot-rpcd的本地替身, 用于测试iot-ubusd的unix传输
+ *
+ * 监听unix套接字, 按4字节大端长度 + 4字节大端请求id + 内容的帧格式接收请求,
+ * 原样包装后回复: {"code": 0, "data": <请求内容>}
+ * 回复帧带回请求id; 长度最高位标记的压缩请求先解压;
+ * 指定-z时超过阈值的回复同样以zlib压缩并标记后发送。
+ * 指定-r时按iot-ubusd-replay -o导出的响应长度表填充回复, 复现抓包时的响应大小:
+ * 同一object.method的请求依次使用表中该方法的长度, 用完后从头循环
+ *
+ * 用法:
+ *   iot-rpcd-stub -u /tmp/iot-rpcd.sock &
+ *   iot-ubusd -t unix -u /tmp/iot-rpcd.sock
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <zlib.h>
+
+#define STUB_MAX_CLIENTS 16
+#define STUB_FRAME_HDR_SIZE 8
+#define STUB_FRAME_MAX_SIZE (16 * 1024 * 1024)
+#define STUB_FRAME_COMPRESSED 0x80000000U
+#define STUB_REPLY_PREFIX "{\"code\": 0, \"data\": "
+#define STUB_REPLY_SUFFIX "}"
+#define STUB_REPLY_PAD_PREFIX "{\"code\": 0, \"pad\": \""
+#define STUB_REPLY_PAD_SUFFIX "\", \"data\": "
+#define STUB_NAME_MAX 256
+
+struct stub_client {
+    int fd;
+    char *rx;
+    size_t rx_len;
+    size_t rx_size;
+};
+
+struct stub_size {
+    char key[STUB_NAME_MAX * 2];  /**< "object method" */
+    uint32_t *sizes;              /**< 按抓包顺序的响应长度 */
+    size_t n;
+    size_t next;
+};
+
+static volatile sig_atomic_t s_signo = 0;
+static struct stub_size *s_sizes = NULL;
+static size_t s_n_sizes = 0;
+static int s_delay_ms = 0;
+static int s_compress_threshold = 0;
+static int s_verbose = 0;
+
+static void signal_handler(int signo) {
+    s_signo = signo;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s OPTIONS\n"
+        "  -u PATH  - unix socket path, default: '/var/run/iot-rpcd.sock'\n"
+        "  -d MS    - reply delay in milliseconds, default: 0\n"
+        "  -z n     - compress replies larger than n bytes, 0 to disable, default: 0\n"
+        "  -r PATH  - pad replies to the sizes in a table written by iot-ubusd-replay -o\n"
+        "  -v       - print every request\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static char *inflate_all(const char *data, size_t len, size_t *out_len) {
+    z_stream zs;
+    size_t size = len * 4 + 64;
+    char *out = malloc(size);
+    int ret = Z_OK;
+
+    memset(&zs, 0, sizeof(zs));
+    if (!out || inflateInit(&zs) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+
+    while (ret == Z_OK) {
+        if (zs.total_out == size) {
+            char *p = realloc(out, size * 2);
+            if (!p)
+                break;
+            out = p;
+            size *= 2;
+        }
+        zs.next_out = (Bytef *)out + zs.total_out;
+        zs.avail_out = size - zs.total_out;
+        ret = inflate(&zs, Z_NO_FLUSH);
+    }
+
+    *out_len = zs.total_out;
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+static int send_frame(int fd, const char *body, size_t len, int compressed, uint32_t id) {
+    uint32_t v = (uint32_t)len | (compressed ? STUB_FRAME_COMPRESSED : 0);
+    char hdr[STUB_FRAME_HDR_SIZE] = {
+        (char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v,
+        (char)(id >> 24), (char)(id >> 16), (char)(id >> 8), (char)id,
+    };
+
+    if (write_all(fd, hdr, sizeof(hdr)) != 0)
+        return -1;
+    return write_all(fd, body, len);
+}
+
+/**
+ * @brief 加载响应长度表, 每行: 对象名 方法名 长度
+ */
+static int load_sizes(const char *path) {
+    char object[STUB_NAME_MAX], method[STUB_NAME_MAX];
+    unsigned int size;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fscanf(fp, "%255s %255s %u", object, method, &size) == 3) {
+        char key[STUB_NAME_MAX * 2];
+        struct stub_size *e = NULL;
+
+        snprintf(key, sizeof(key), "%s %s", object, method);
+        for (size_t i = 0; i < s_n_sizes && !e; i++) {
+            if (strcmp(s_sizes[i].key, key) == 0)
+                e = &s_sizes[i];
+        }
+        if (!e) {
+            struct stub_size *p = realloc(s_sizes, (s_n_sizes + 1) * sizeof(struct stub_size));
+            if (!p)
+                break;
+            s_sizes = p;
+            e = &s_sizes[s_n_sizes++];
+            memset(e, 0, sizeof(*e));
+            strcpy(e->key, key);
+        }
+
+        uint32_t *sizes = realloc(e->sizes, (e->n + 1) * sizeof(uint32_t));
+        if (!sizes)
+            break;
+        e->sizes = sizes;
+        e->sizes[e->n++] = size;
+    }
+
+    fclose(fp);
+    printf("loaded response sizes for %lu methods from %s\n", (unsigned long)s_n_sizes, path);
+    return 0;
+}
+
+/**
+ * @brief 在请求中查找"name"字段的字符串值
+ * @return 值之后的位置, 未找到返回0
+ */
+static size_t find_string(const char *s, size_t len, size_t from, const char *name, char *out, size_t size) {
+    size_t n = strlen(name);
+
+    for (size_t i = from; i + n + 2 < len; i++) {
+        if (s[i] != '"' || memcmp(s + i + 1, name, n) != 0 || s[i + n + 1] != '"')
+            continue;
+
+        size_t j = i + n + 2, k = 0;
+        while (j < len && (s[j] == ':' || s[j] == ' ' || s[j] == '\t' || s[j] == '\n' || s[j] == '\r'))
+            j++;
+        if (j >= len || s[j++] != '"')
+            continue;
+        while (j < len && s[j] != '"' && k + 1 < size)
+            out[k++] = s[j++];
+        out[k] = '\0';
+        return j;
+    }
+    return 0;
+}
+
+/**
+ * @brief 按请求的object.method取出下一个抓包时的响应长度
+ * @return 响应长度, 表中没有时返回0
+ */
+static size_t next_size(const char *req, size_t len) {
+    char object[STUB_NAME_MAX], method[STUB_NAME_MAX], key[STUB_NAME_MAX * 2];
+
+    // build_call_request中object在method之前, 顶层的"method": "call"在两者之前
+    size_t pos = find_string(req, len, 0, "object", object, sizeof(object));
+    if (!pos || !find_string(req, len, pos, "method", method, sizeof(method)))
+        return 0;
+
+    snprintf(key, sizeof(key), "%s %s", object, method);
+    for (size_t i = 0; i < s_n_sizes; i++) {
+        struct stub_size *e = &s_sizes[i];
+        if (strcmp(e->key, key) == 0) {
+            size_t size = e->sizes[e->next];
+            e->next = (e->next + 1) % e->n;
+            return size;
+        }
+    }
+    return 0;
+}
+
+static int reply(int fd, const char *req, size_t len, int compressed, uint32_t id) {
+    char *plain = NULL;
+
+    if (compressed) {
+        plain = inflate_all(req, len, &len);
+        if (!plain)
+            return -1;
+        req = plain;
+    }
+    if (s_verbose)
+        printf("request: %.*s\n", (int)len, req);
+
+    size_t body_len = strlen(STUB_REPLY_PREFIX) + len + strlen(STUB_REPLY_SUFFIX);
+    size_t pad_len = 0, size = s_n_sizes ? next_size(req, len) : 0;
+    size_t pad_body_len = strlen(STUB_REPLY_PAD_PREFIX) + strlen(STUB_REPLY_PAD_SUFFIX) + len + strlen(STUB_REPLY_SUFFIX);
+    if (size > pad_body_len) {
+        pad_len = size - pad_body_len;
+        body_len = size;
+    }
+
+    char *body = malloc(body_len);
+    if (!body) {
+        free(plain);
+        return -1;
+    }
+
+    char *p = body;
+    if (pad_len) {
+        // 随机字母填充, 避免全部相同字符时-z的压缩率失真
+        memcpy(p, STUB_REPLY_PAD_PREFIX, strlen(STUB_REPLY_PAD_PREFIX));
+        p += strlen(STUB_REPLY_PAD_PREFIX);
+        for (size_t i = 0; i < pad_len; i++)
+            *p++ = (char)('a' + rand() % 26);
+        memcpy(p, STUB_REPLY_PAD_SUFFIX, strlen(STUB_REPLY_PAD_SUFFIX));
+        p += strlen(STUB_REPLY_PAD_SUFFIX);
+    } else {
+        memcpy(p, STUB_REPLY_PREFIX, strlen(STUB_REPLY_PREFIX));
+        p += strlen(STUB_REPLY_PREFIX);
+    }
+    memcpy(p, req, len);
+    p += len;
+    memcpy(p, STUB_REPLY_SUFFIX, strlen(STUB_REPLY_SUFFIX));
+    free(plain);
+
+    compressed = 0;
+    if (s_compress_threshold > 0 && body_len >= (size_t)s_compress_threshold) {
+        uLongf zlen = compressBound(body_len);
+        char *zbody = malloc(zlen);
+        // 与iot-ubusd相同, 压缩后不更小时发送原文
+        if (zbody && compress2((Bytef *)zbody, &zlen, (Bytef *)body, body_len, Z_DEFAULT_COMPRESSION) == Z_OK &&
+            zlen < body_len) {
+            free(body);
+            body = zbody;
+            body_len = zlen;
+            compressed = 1;
+        } else {
+            free(zbody);
+        }
+    }
+
+    if (s_delay_ms > 0)
+        usleep(s_delay_ms * 1000);
+
+    int ret = send_frame(fd, body, body_len, compressed, id);
+    free(body);
+    return ret;
+}
+
+static int client_read(struct stub_client *cl) {
+    if (cl->rx_size - cl->rx_len < 1024) {
+        size_t size = cl->rx_size ? cl->rx_size * 2 : 4096;
+        char *rx = realloc(cl->rx, size);
+        if (!rx)
+            return -1;
+        cl->rx = rx;
+        cl->rx_size = size;
+    }
+
+    ssize_t n = recv(cl->fd, cl->rx + cl->rx_len, cl->rx_size - cl->rx_len, 0);
+    if (n <= 0)
+        return n < 0 && errno == EINTR ? 0 : -1;
+    cl->rx_len += n;
+
+    while (cl->rx_len >= STUB_FRAME_HDR_SIZE) {
+        const uint8_t *p = (const uint8_t *)cl->rx;
+        uint32_t hdr = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        uint32_t id = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+        size_t len = hdr & ~STUB_FRAME_COMPRESSED;
+        if (len > STUB_FRAME_MAX_SIZE)
+            return -1;
+        if (cl->rx_len < STUB_FRAME_HDR_SIZE + len)
+            break;
+
+        if (reply(cl->fd, cl->rx + STUB_FRAME_HDR_SIZE, len, (hdr & STUB_FRAME_COMPRESSED) != 0, id) != 0)
+            return -1;
+
+        cl->rx_len -= STUB_FRAME_HDR_SIZE + len;
+        memmove(cl->rx, cl->rx + STUB_FRAME_HDR_SIZE + len, cl->rx_len);
+    }
+    return 0;
+}
+
+static void client_close(struct stub_client *cl) {
+    close(cl->fd);
+    free(cl->rx);
+    memset(cl, 0, sizeof(*cl));
+    cl->fd = -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "/var/run/iot-rpcd.sock";
+    struct stub_client clients[STUB_MAX_CLIENTS];
+    struct pollfd pfds[STUB_MAX_CLIENTS + 1];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            s_delay_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+            s_compress_threshold = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (load_sizes(argv[++i]) != 0)
+                return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            s_verbose = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, STUB_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "cannot listen on %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    for (int i = 0; i < STUB_MAX_CLIENTS; i++) {
+        memset(&clients[i], 0, sizeof(clients[i]));
+        clients[i].fd = -1;
+    }
+
+    printf("iot-rpcd stub listening on %s\n", path);
+    fflush(stdout);
+
+    while (s_signo == 0) {
+        pfds[0].fd = lfd;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < STUB_MAX_CLIENTS; i++) {
+            pfds[i + 1].fd = clients[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
+
+        if (poll(pfds, STUB_MAX_CLIENTS + 1, 100) <= 0)
+            continue;
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept(lfd, NULL, NULL);
+            int i = 0;
+            while (fd >= 0 && i < STUB_MAX_CLIENTS && clients[i].fd >= 0)
+                i++;
+            if (fd >= 0 && i < STUB_MAX_CLIENTS)
+                clients[i].fd = fd;
+            else if (fd >= 0)
+                close(fd);
+        }
+
+        for (int i = 0; i < STUB_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && (pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                client_read(&clients[i]) != 0)
+                client_close(&clients[i]);
+        }
+    }
+
+    for (int i = 0; i < STUB_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0)
+            client_close(&clients[i]);
+    }
+    close(lfd);
+    unlink(path);
+
+    for (size_t i = 0; i < s_n_sizes; i++)
+        free(s_sizes[i].sizes);
+    free(s_sizes);
+
+    return 0;
+}
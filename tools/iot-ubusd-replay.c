@@ -0,0 +1,389 @@
+/**
+ * @file iot-ubusd-replay.c
+ * @brief 回放iot-ubusd抓包文件(-w)中的ubus调用并统计延迟分布
+ *
+ * 按文件顺序和抓包时的单调时钟间隔依次调用本地ubus对象, 可按倍速或尽快回放,
+ * 结束后输出抓包时与回放时的延迟分布, 以及各对象方法的回放延迟。
+ * 间隔为负(跨重启)时立即回放, 超过-g时按-g回放; 被限流拒绝的调用默认跳过。
+ * -o导出各调用抓包时的响应长度, 供iot-rpcd-stub -r按原大小填充回复。
+ * 配合iot-rpcd-stub可以在工作站上复现设备的负载:
+ *
+ *   iot-ubusd-replay -f calls.cap -o sizes.txt
+ *   iot-rpcd-stub -u /tmp/iot-rpcd.sock -r sizes.txt &
+ *   iot-ubusd -t unix -u /tmp/iot-rpcd.sock -c iot-ubusd.json &
+ *   iot-ubusd-replay -f calls.cap -x 10
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <libubox/blobmsg.h>
+#include <libubox/blobmsg_json.h>
+#include <libubus.h>
+#include "capture.h"
+
+struct replay_record {
+    uint64_t mono;             /**< 抓包时调用开始时间, 微秒, 单调时钟 */
+    uint64_t realtime;         /**< 抓包时调用开始时间, 微秒, 仅用于显示 */
+    uint32_t captured;         /**< 抓包时耗时, 微秒 */
+    uint32_t response;         /**< 抓包时响应长度(解压后) */
+    uint32_t flags;            /**< UBUSD_CAPTURE_F_* */
+    uint32_t replayed;         /**< 回放耗时, 微秒 */
+    int status;                /**< 回放ubus状态码 */
+    int skipped;               /**< 未回放的限流调用 */
+    char *object;
+    char *method;
+    char *args;
+};
+
+struct replay_object {
+    char *name;
+    uint32_t id;
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s OPTIONS\n"
+        "  -f PATH  - capture file written by iot-ubusd -w\n"
+        "  -x N     - replay speed, 1 for real time, 0 for as fast as possible, default: 1\n"
+        "  -g MS    - max gap between two calls, longer gaps are shortened, default: 10000\n"
+        "  -o PATH  - write captured response sizes for iot-rpcd-stub -r and exit\n"
+        "  -l       - also replay calls that were rate limited when captured, without args\n"
+        "  -t MS    - ubus call timeout, default: 10000\n"
+        "  -s PATH  - ubus socket path, default: libubus default\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(uint64_t due) {
+    uint64_t now;
+
+    while ((now = now_us()) < due) {
+        struct timespec ts = { .tv_sec = (due - now) / 1000000, .tv_nsec = (due - now) % 1000000 * 1000 };
+        if (nanosleep(&ts, NULL) != 0 && errno != EINTR)
+            break;
+    }
+}
+
+/**
+ * @brief 计算两条记录之间的回放间隔
+ * @return 微秒, 单调时钟回退(跨重启)时为0, 最长max_gap
+ */
+static uint64_t record_gap(const struct replay_record *prev, const struct replay_record *r, uint64_t max_gap) {
+    if (!prev || r->mono <= prev->mono)
+        return 0;
+    return r->mono - prev->mono > max_gap ? max_gap : r->mono - prev->mono;
+}
+
+static char *read_str(FILE *fp, size_t len) {
+    char *s = malloc(len + 1);
+    if (!s)
+        return NULL;
+    if (len && fread(s, 1, len, fp) != len) {
+        free(s);
+        return NULL;
+    }
+    s[len] = '\0';
+    return s;
+}
+
+static struct replay_record *load(const char *path, size_t *n) {
+    uint8_t hdr[UBUSD_CAPTURE_HDR_SIZE], rec[UBUSD_CAPTURE_REC_SIZE];
+    struct replay_record *records = NULL;
+    size_t count = 0, size = 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || memcmp(hdr, UBUSD_CAPTURE_MAGIC, 4) != 0 ||
+        capture_get_le32(hdr + 4) != UBUSD_CAPTURE_VERSION) {
+        fprintf(stderr, "%s: not an iot-ubusd capture file\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    while (fread(rec, 1, sizeof(rec), fp) == sizeof(rec)) {
+        if (count == size) {
+            size = size ? size * 2 : 1024;
+            struct replay_record *p = realloc(records, size * sizeof(struct replay_record));
+            if (!p)
+                break;
+            records = p;
+        }
+
+        struct replay_record *r = &records[count];
+        memset(r, 0, sizeof(*r));
+        r->mono = capture_get_le64(rec);
+        r->realtime = capture_get_le64(rec + 8);
+        r->captured = capture_get_le32(rec + 16);
+        r->response = capture_get_le32(rec + 20);
+        r->flags = capture_get_le32(rec + 28);
+        r->object = read_str(fp, capture_get_le16(rec + 32));
+        r->method = read_str(fp, capture_get_le16(rec + 34));
+        r->args = read_str(fp, capture_get_le32(rec + 24));
+        if (!r->object || !r->method || !r->args) {
+            fprintf(stderr, "%s: truncated record %lu\n", path, (unsigned long)count);
+            free(r->object);
+            free(r->method);
+            free(r->args);
+            break;
+        }
+        count++;
+    }
+
+    fclose(fp);
+    *n = count;
+    return records;
+}
+
+static int lookup(struct ubus_context *ctx, struct replay_object **objects, size_t *n_objects,
+                  const char *name, uint32_t *id) {
+    for (size_t i = 0; i < *n_objects; i++) {
+        if (strcmp((*objects)[i].name, name) == 0) {
+            *id = (*objects)[i].id;
+            return 0;
+        }
+    }
+
+    int ret = ubus_lookup_id(ctx, name, id);
+    if (ret != 0)
+        return ret;
+
+    struct replay_object *p = realloc(*objects, (*n_objects + 1) * sizeof(struct replay_object));
+    if (p) {
+        p[*n_objects].name = strdup(name);
+        p[*n_objects].id = *id;
+        *objects = p;
+        (*n_objects)++;
+    }
+    return 0;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, uint32_t *lat, size_t n, size_t errors) {
+    uint64_t sum = 0;
+
+    if (n == 0) {
+        printf("%-32s %8lu %8lu\n", name, 0UL, (unsigned long)errors);
+        return;
+    }
+
+    qsort(lat, n, sizeof(uint32_t), cmp_u32);
+    for (size_t i = 0; i < n; i++)
+        sum += lat[i];
+
+    printf("%-32s %8lu %8lu %10u %10lu %10u %10u %10u %10u\n", name, (unsigned long)n, (unsigned long)errors,
+        lat[0], (unsigned long)(sum / n), lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100], lat[n - 1]);
+}
+
+/**
+ * @brief 按抓包顺序导出响应长度表, 每行: 对象名 方法名 长度
+ */
+static int write_sizes(const char *path, const struct replay_record *records, size_t n, int include_limited) {
+    FILE *fp = fopen(path, "w");
+    size_t count = 0;
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const struct replay_record *r = &records[i];
+        if (!include_limited && (r->flags & UBUSD_CAPTURE_F_LIMITED))
+            continue;
+        fprintf(fp, "%s %s %u\n", r->object, r->method, r->response);
+        count++;
+    }
+
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    printf("wrote %lu response sizes to %s\n", (unsigned long)count, path);
+    return 0;
+}
+
+static void print_time(const char *label, uint64_t us) {
+    char buf[32];
+    time_t t = (time_t)(us / 1000000);
+    struct tm tm;
+
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+    printf("%s%s", label, buf);
+}
+
+static int cmp_key(const void *a, const void *b) {
+    const struct replay_record *x = a, *y = b;
+    int r = strcmp(x->object, y->object);
+    return r ? r : strcmp(x->method, y->method);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL, *ubus_socket = NULL, *sizes_path = NULL;
+    double speed = 1;
+    int timeout = 10000, include_limited = 0;
+    uint64_t max_gap = 10000000;
+    struct replay_object *objects = NULL;
+    size_t n = 0, n_objects = 0, errors = 0, skipped = 0;
+    struct blob_buf bb;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            max_gap = strtoull(argv[++i], NULL, 10) * 1000;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            sizes_path = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            include_limited = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            ubus_socket = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!path || speed < 0)
+        usage(argv[0]);
+
+    struct replay_record *records = load(path, &n);
+    if (!records || n == 0) {
+        fprintf(stderr, "no records to replay\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sizes_path) {
+        int ret = write_sizes(sizes_path, records, n, include_limited);
+        for (size_t i = 0; i < n; i++) {
+            free(records[i].object);
+            free(records[i].method);
+            free(records[i].args);
+        }
+        free(records);
+        return ret ? EXIT_FAILURE : 0;
+    }
+
+    struct ubus_context *ctx = ubus_connect(ubus_socket);
+    if (!ctx) {
+        fprintf(stderr, "failed to connect to ubus\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&bb, 0, sizeof(bb));
+    uint64_t begin = now_us(), due = begin, span = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        struct replay_record *r = &records[i];
+        uint64_t gap = record_gap(i ? &records[i - 1] : NULL, r, max_gap);
+        uint32_t id;
+
+        span += gap;
+        if (!include_limited && (r->flags & UBUSD_CAPTURE_F_LIMITED)) {
+            r->skipped = 1;
+            skipped++;
+            continue;
+        }
+
+        if (speed > 0) {
+            due += (uint64_t)(gap / speed);
+            sleep_until(due);
+        }
+
+        blob_buf_init(&bb, 0);
+        if (r->args[0])
+            blobmsg_add_json_from_string(&bb, r->args);
+
+        uint64_t start = now_us();
+        r->status = lookup(ctx, &objects, &n_objects, r->object, &id);
+        if (r->status == 0)
+            r->status = ubus_invoke(ctx, id, r->method, bb.head, NULL, NULL, timeout);
+        r->replayed = (uint32_t)(now_us() - start);
+
+        if (r->status != 0) {
+            errors++;
+            fprintf(stderr, "%s.%s: %s\n", r->object, r->method, ubus_strerror(r->status));
+        }
+    }
+
+    uint64_t elapsed = now_us() - begin;
+    print_time("captured from ", records[0].realtime);
+    print_time(" to ", records[n - 1].realtime);
+    printf(", skipped %lu rate limited calls\n", (unsigned long)skipped);
+    printf("replayed %lu calls in %.3fs, captured span %.3fs\n", (unsigned long)(n - skipped), elapsed / 1e6,
+        span / 1e6);
+    printf("%-32s %8s %8s %10s %10s %10s %10s %10s %10s\n", "latency(us)", "calls", "errors",
+        "min", "mean", "p50", "p90", "p99", "max");
+
+    uint32_t *lat = calloc(n, sizeof(uint32_t));
+    if (!lat)
+        return EXIT_FAILURE;
+
+    size_t ok = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!records[i].skipped)
+            lat[ok++] = records[i].captured;
+    }
+    report("captured", lat, ok, 0);
+
+    ok = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!records[i].skipped && records[i].status == 0)
+            lat[ok++] = records[i].replayed;
+    }
+    report("replayed", lat, ok, errors);
+
+    qsort(records, n, sizeof(struct replay_record), cmp_key);
+    for (size_t i = 0; i < n;) {
+        char name[256];
+        size_t j = i, m = 0, err = 0, calls = 0;
+        while (j < n && cmp_key(&records[i], &records[j]) == 0) {
+            if (!records[j].skipped) {
+                calls++;
+                if (records[j].status == 0)
+                    lat[m++] = records[j].replayed;
+                else
+                    err++;
+            }
+            j++;
+        }
+        snprintf(name, sizeof(name), "%s.%s", records[i].object, records[i].method);
+        if (calls)
+            report(name, lat, m, err);
+        i = j;
+    }
+
+    free(lat);
+    blob_buf_free(&bb);
+    ubus_free(ctx);
+
+    for (size_t i = 0; i < n; i++) {
+        free(records[i].object);
+        free(records[i].method);
+        free(records[i].args);
+    }
+    free(records);
+    for (size_t i = 0; i < n_objects; i++)
+        free(objects[i].name);
+    free(objects);
+
+    return errors ? EXIT_FAILURE : 0;
+}
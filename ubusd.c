@@ -15,6 +15,7 @@
 #include <libubox/ustream.h>
 #include <libubox/utils.h>
 #include <libubus.h>
+#include <zlib.h>
 #include <iot/mongoose.h>
 #include <iot/cJSON.h>
 #include <iot/iot.h>
@@ -23,9 +24,27 @@
 struct ubus_object_ext {
     struct ubus_object obj;
     void *priv;
+    int qos;             /**< 对象默认发布qos */
+    uint8_t *method_qos; /**< 各方法发布qos, 与obj.methods一一对应 */
+};
+
+/* ubus调用方统计输出间隔, 60S */
+#define PEER_STATS_INTERVAL 60000
+
+/* 新调用方的初始令牌, 单位1/1000请求, 即1个请求 */
+#define PEER_NEW_TOKENS 1000
+
+/* 上游请求超时, 包括等待request槽空闲的时间, 10S */
+#define REQUEST_TIMEOUT 10000
+
+struct peer_stats_timeout {
+    struct uloop_timeout timeout;
+    struct ubusd_private *priv;
 };
 
 static int *s_signo = NULL;
+static uint32_t s_request_id = 0;
+static struct peer_stats_timeout s_peer_stats;
 
 /**
  * @brief 信号处理函数
@@ -36,6 +55,245 @@ static void signal_handler(int signo) {
     uloop_end();
 }
 
+/**
+ * @brief 判断调用方记录能否被淘汰
+ * @param priv 程序私有数据
+ * @param peer 调用方记录
+ * @param now 当前时间
+ * @return 1表示可以淘汰
+ *
+ * 只淘汰空闲超过peer_burst/peer_rate秒(令牌已补满)的调用方,
+ * 频繁更换peer id的客户端不能把仍在补充令牌的调用方挤出跟踪表
+ */
+static int peer_evictable(struct ubusd_private *priv, struct ubusd_peer *peer, uint64_t now) {
+    struct ubusd_option *opts = priv->cfg.opts;
+
+    if (peer->id == 0 || opts->peer_rate <= 0)
+        return 1;
+    return now - peer->active > (uint64_t)opts->peer_burst * 1000 / opts->peer_rate;
+}
+
+/**
+ * @brief 查找ubus调用方, 不存在时占用空闲项或可淘汰项中最久未活动的项
+ * @param priv 程序私有数据
+ * @param id ubus peer id
+ * @param now 当前时间
+ * @return 调用方记录, 跟踪表中没有可用项时返回共享的溢出记录
+ *
+ * 新占用的项只有PEER_NEW_TOKENS个令牌, 不补满到peer_burst,
+ * 反复重启的客户端不能靠新的peer id获得突发
+ */
+static struct ubusd_peer *peer_get(struct ubusd_private *priv, uint32_t id, uint64_t now) {
+    struct ubusd_peer *victim = NULL;
+
+    for (int i = 0; i < UBUSD_PEER_MAX; i++) {
+        struct ubusd_peer *peer = &priv->peers[i];
+        if (peer->id == id)
+            return peer;
+        if (!peer_evictable(priv, peer, now))
+            continue;
+        if (!victim || peer->id == 0 || (victim->id != 0 && peer->active < victim->active))
+            victim = peer;
+    }
+
+    if (!victim)
+        return &priv->peer_overflow;
+
+    if (victim->id != 0) {
+        MG_DEBUG(("evict ubus peer: %08x, accepted: %llu, rejected: %llu", victim->id,
+            (unsigned long long)victim->total_accepted, (unsigned long long)victim->total_rejected));
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->id = id;
+    victim->tokens = PEER_NEW_TOKENS;
+    victim->refill = now;
+    return victim;
+}
+
+/**
+ * @brief 按令牌桶判断是否接受ubus调用方的请求
+ * @param priv 程序私有数据
+ * @param id ubus peer id
+ * @return 0表示接受, -1表示超出限制
+ *
+ * 每个调用方每秒补充peer_rate个令牌, 最多累积peer_burst个,
+ * 超出限制的请求立即拒绝, 不占用上游请求槽
+ */
+static int peer_admit(struct ubusd_private *priv, uint32_t id) {
+    struct ubusd_option *opts = priv->cfg.opts;
+    uint64_t now = mg_millis();
+    struct ubusd_peer *peer = peer_get(priv, id, now);
+
+    peer->active = now;
+
+    if (opts->peer_rate > 0) {
+        if (now > peer->refill) {
+            peer->tokens += (int64_t)(now - peer->refill) * opts->peer_rate;
+            if (peer->tokens > (int64_t)opts->peer_burst * 1000)
+                peer->tokens = (int64_t)opts->peer_burst * 1000;
+        }
+        peer->refill = now;
+
+        if (peer->tokens < 1000) {
+            peer->rejected++;
+            peer->total_rejected++;
+            return -1;
+        }
+        peer->tokens -= 1000;
+    }
+
+    peer->accepted++;
+    peer->total_accepted++;
+    return 0;
+}
+
+/**
+ * @brief 定时输出ubus调用方的统计计数
+ * @param t 定时器
+ */
+static void peer_stats_cb(struct uloop_timeout *t) {
+    struct peer_stats_timeout *stats = container_of(t, struct peer_stats_timeout, timeout);
+    struct ubusd_private *priv = stats->priv;
+
+    for (int i = 0; i < UBUSD_PEER_MAX; i++) {
+        struct ubusd_peer *peer = &priv->peers[i];
+        if (peer->id == 0 || (peer->accepted == 0 && peer->rejected == 0))
+            continue;
+        MG_INFO(("ubus peer: %08x, accepted: %u(%llu), rejected: %u(%llu)", peer->id,
+            peer->accepted, (unsigned long long)peer->total_accepted,
+            peer->rejected, (unsigned long long)peer->total_rejected));
+        peer->accepted = 0;
+        peer->rejected = 0;
+    }
+
+    struct ubusd_peer *overflow = &priv->peer_overflow;
+    if (overflow->accepted || overflow->rejected) {
+        MG_INFO(("ubus peer: overflow, accepted: %u(%llu), rejected: %u(%llu)",
+            overflow->accepted, (unsigned long long)overflow->total_accepted,
+            overflow->rejected, (unsigned long long)overflow->total_rejected));
+        overflow->accepted = 0;
+        overflow->rejected = 0;
+    }
+
+    uloop_timeout_set(t, PEER_STATS_INTERVAL);
+}
+
+/**
+ * @brief 将JSON响应转换为blob格式并响应
+ * @param ctx ubus上下文
+ * @param req 请求数据
+ * @param response JSON字符串或zlib压缩的JSON
+ * @param len 响应长度
+ * @param compressed 响应是否为zlib压缩消息
+ * @return 响应的JSON文本长度, 压缩响应为解压后的长度
+ */
+static size_t send_reply(struct ubus_context *ctx, struct ubus_request_data *req, const char *response, size_t len,
+                         int compressed) {
+    static const char *invalid = "{\"code\": -1, \"msg\": \"invalid data\"}";
+    struct blob_buf bb;
+
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+
+    if (compressed) {
+        if (ubusd_inflate_json(&bb, response, len, &len) != 0) {
+            MG_ERROR(("invalid compressed response, size: %lu", (unsigned long)len));
+            blob_buf_init(&bb, 0);
+            blobmsg_add_json_from_string(&bb, invalid);
+            len = strlen(invalid);
+        }
+    } else {
+        blobmsg_add_json_from_string(&bb, response);
+    }
+
+    ubus_send_reply(ctx, req, bb.head);
+    blob_buf_free(&bb);
+    return len;
+}
+
+/**
+ * @brief 将请求放入request槽, 由传输层发送
+ * @param priv 程序私有数据
+ * @param data 请求内容
+ * @param len 请求长度
+ * @param qos 发布qos
+ * @param compressed 请求是否为zlib压缩消息
+ * @return 请求id, 失败返回0
+ */
+static uint32_t post_request(struct ubusd_private *priv, const char *data, size_t len, int qos, int compressed) {
+    priv->request = malloc(len);
+    if (!priv->request)
+        return 0;
+    memcpy(priv->request, data, len);
+    if (++s_request_id == 0)
+        s_request_id = 1;
+    priv->request_id = s_request_id;
+    priv->request_len = len;
+    priv->request_qos = qos;
+    priv->request_compressed = compressed;
+    __sync_synchronize();
+    priv->request_full = 1;
+    return s_request_id;
+}
+
+/**
+ * @brief 超时后收回传输层尚未取走的请求
+ * @param priv 程序私有数据
+ */
+static void reclaim_request(struct ubusd_private *priv) {
+    if (__sync_bool_compare_and_swap(&priv->request_full, 1, 0)) {
+        MG_ERROR(("request %u not sent before timeout, dropped", priv->request_id));
+        free(priv->request);
+        priv->request = NULL;
+    }
+}
+
+/**
+ * @brief 传输层取得request槽中的请求, 与超时收回互斥
+ * @param priv 程序私有数据
+ * @return 1表示取得, 之后由传输层读取请求并调用ubusd_request_release
+ */
+int ubusd_request_claim(struct ubusd_private *priv) {
+    return __sync_bool_compare_and_swap(&priv->request_full, 1, 2);
+}
+
+/**
+ * @brief 传输层处理完请求后释放request槽
+ * @param priv 程序私有数据
+ */
+void ubusd_request_release(struct ubusd_private *priv) {
+    free(priv->request);
+    priv->request = NULL;
+    __sync_synchronize();
+    priv->request_full = 0;
+}
+
+/**
+ * @brief 丢弃response槽中的响应
+ * @param priv 程序私有数据
+ */
+static void drop_response(struct ubusd_private *priv) {
+    free(priv->response);
+    priv->response = NULL;
+    __sync_synchronize();
+    priv->response_full = 0;
+}
+
+/**
+ * @brief 查找方法对应的发布qos
+ * @param obj_ext ubus对象
+ * @param method 方法名
+ * @return qos等级
+ */
+static int method_qos(struct ubus_object_ext *obj_ext, const char *method) {
+    for (int i = 0; i < obj_ext->obj.n_methods; i++) {
+        if (strcmp(obj_ext->obj.methods[i].name, method) == 0)
+            return obj_ext->method_qos[i];
+    }
+    return obj_ext->qos;
+}
+
 /**
  * @brief ubus请求处理回调函数
  * @param ctx ubus上下文
@@ -46,95 +304,121 @@ static void signal_handler(int signo) {
  * @return 0表示成功,其他值表示失败
  * 
  * 该函数负责:
- * 1. 将blob格式参数转换为JSON字符串
- * 2. 调用do_handler处理请求
- * 3. 将处理结果转换回blob格式并响应
+ * 1. 按调用方限流, 超出限制立即拒绝
+ * 2. 将blob格式参数转换为JSON字符串
+ * 3. 超过阈值的请求压缩后, 调用do_handler处理请求
+ * 4. 将处理结果(必要时解压)转换回blob格式并响应
+ * 5. 开启抓包时记录本次调用
  */
 static int ubus_handler(struct ubus_context *ctx, struct ubus_object *obj,
                     struct ubus_request_data *req, const char *method,
                     struct blob_attr *msg) {
-    struct blob_buf bb;
     const char *response = NULL;
+    size_t response_len = 0;
     struct ubus_object_ext *obj_ext = container_of(obj, struct ubus_object_ext, obj);
     struct ubusd_private *priv = (struct ubusd_private *)obj_ext->priv;
+    int qos = method_qos(obj_ext, method);
+    uint64_t start = priv->capture.fd >= 0 ? ubusd_capture_clock() : 0;
+
+    if (peer_admit(priv, req->peer) != 0) {
+        MG_DEBUG(("ubus peer: %08x rate limited, object: %s, method: %s", req->peer, obj->name, method));
+        response = "{\"code\": -1, \"msg\": \"rate limited\"}\n";
+        send_reply(ctx, req, response, strlen(response), 0);
+        if (priv->capture.fd >= 0) // no args, keep rejections cheap and small
+            ubusd_capture_record(&priv->capture, start, obj->name, method, NULL, strlen(response), 1);
+        return 0;
+    }
 
-    char *json_msg = blobmsg_format_json(msg, true);
+    char *args = blobmsg_format_json(msg, true);
+    char *json_msg = args;
 
-    MG_DEBUG(("ubus call object: %s, method: %s, param: %s", obj->name, method, json_msg));
+    MG_DEBUG(("ubus call object: %s, method: %s, param: %s", obj->name, method, args));
 
     char *out = NULL;
+    int out_compressed = 0;
+    char *zmsg = NULL;
 
-    if (json_msg) {
+    if (args) {
         if (strcmp(obj->name, "iot-ubusd") != 0 || strcmp(method, "iot-rpc") != 0) { // not iot-rpc
-            cJSON *root = cJSON_CreateObject();
-            cJSON_AddStringToObject(root, FIELD_METHOD, "call");
-
-            cJSON *param = cJSON_CreateArray();
-            cJSON_AddItemToArray(param, cJSON_CreateString(priv->cfg.opts->module));
-            cJSON_AddItemToArray(param, cJSON_CreateString(priv->cfg.opts->func));
-
-            cJSON *args = cJSON_CreateObject();
-            cJSON_AddItemToObject(args, "object", cJSON_CreateString(obj->name));
-            cJSON_AddItemToObject(args, "method", cJSON_CreateString(method));
-            cJSON *data_obj = cJSON_Parse(json_msg);
-            cJSON_AddItemToObject(args, FIELD_DATA, data_obj);
-            cJSON_AddItemToArray(param, args);
-
-            cJSON_AddItemToObject(root, FIELD_PARAM, param);
-            free(json_msg);
+            cJSON *root = build_call_request(priv->cfg.opts, obj->name, method, args);
             json_msg = cJSON_Print(root);
+            cJSON_Delete(root);
+        }
+
+        const char *payload = json_msg;
+        size_t payload_len = strlen(json_msg);
+        int threshold = priv->cfg.opts->compress_threshold;
+        if (threshold > 0 && payload_len >= (size_t)threshold) {
+            size_t zlen = 0;
+            zmsg = ubusd_deflate(json_msg, payload_len, Z_DEFAULT_COMPRESSION, &zlen);
+            if (zmsg) {
+                MG_DEBUG(("compress request %lu -> %lu bytes", (unsigned long)payload_len, (unsigned long)zlen));
+                payload = zmsg;
+                payload_len = zlen;
+            }
         }
-        while ( priv->request_full && priv->signo == 0 ) {
+
+        // TIMEOUT, 10S, including the wait for the request slot
+        uint64_t deadline = mg_millis() + REQUEST_TIMEOUT;
+        uint32_t id = 0;
+
+        while ( priv->request_full && priv->signo == 0 && mg_millis() < deadline ) {
             usleep(1000);
         }
 
         if ( priv->response_full ) { // clear unhandled response
-            free(priv->response);
-            priv->response = NULL;
-            __sync_synchronize();
-            priv->response_full = 0;
+            drop_response(priv);
         }
 
         if ( !priv->request_full ) {
-            priv->request = strdup(json_msg);
-            __sync_synchronize();
-            priv->request_full = 1;
+            id = post_request(priv, payload, payload_len, qos, zmsg != NULL);
         }
 
-        // TIMEOUT, 10S, 1000*10ms
-        int try = 0;
-        while ( !priv->response_full && try++ < 1000 && priv->signo == 0 ) {
+        while ( id && priv->signo == 0 && mg_millis() < deadline ) {
+            if ( priv->response_full ) {
+                if ( priv->response_id == id ) {
+                    out = priv->response;
+                    response_len = priv->response_len;
+                    out_compressed = priv->response_compressed;
+                    priv->response = NULL;
+                    __sync_synchronize();
+                    priv->response_full = 0;
+                    break;
+                }
+                MG_DEBUG(("drop late response %u, waiting for %u", priv->response_id, id));
+                drop_response(priv);
+            }
             usleep(10000);
         }
 
-        if ( priv->response_full ) {
-            out = strdup(priv->response);
-            free(priv->response);
-            priv->response = NULL;
-            __sync_synchronize();
-            priv->response_full = 0;
+        if ( id && !out ) {
+            reclaim_request(priv);
         }
     }
     if (!out) {
         response = "{\"code\": -1, \"msg\": \"no data\"}\n";
+        response_len = strlen(response);
     } else {
         response = out;
     }
 
-    memset(&bb, 0, sizeof(bb));
-    blob_buf_init(&bb, 0);
+    response_len = send_reply(ctx, req, response, response_len, out_compressed);
 
-    blobmsg_add_json_from_string(&bb, response);
-
-    ubus_send_reply(ctx, req, bb.head);
-    blob_buf_free(&bb);
+    if (priv->capture.fd >= 0)
+        ubusd_capture_record(&priv->capture, start, obj->name, method, args, response_len, 0);
 
     if (out)
         free(out);
 
-    if (json_msg)
+    if (zmsg)
+        free(zmsg);
+
+    if (json_msg && json_msg != args)
         free(json_msg);
 
+    if (args)
+        free(args);
+
     return 0;
 }
 
@@ -146,26 +430,20 @@ static int ubus_handler(struct ubus_context *ctx, struct ubus_object *obj,
     } while (0)
 
 /**
- * @brief 将字符串类型转换为blobmsg类型
- * @param type 类型字符串
- * @return blobmsg类型枚举值
+ * @brief 解析配置中的qos字段
+ * @param qos JSON格式的qos值
+ * @param def 未配置或非法时的默认值
+ * @return qos等级(0-2)
  */
-static int blogmsg_type(const char *type) {
-    if (strcmp(type, "BLOBMSG_TYPE_STRING") == 0) {
-        return BLOBMSG_TYPE_STRING;
-    } else if (strcmp(type, "BLOBMSG_TYPE_INT32") == 0) {
-        return BLOBMSG_TYPE_INT32;
-    } else if (strcmp(type, "BLOBMSG_TYPE_BOOL") == 0) {
-        return BLOBMSG_TYPE_BOOL;
-    } else if (strcmp(type, "BLOBMSG_TYPE_TABLE") == 0) {
-        return BLOBMSG_TYPE_TABLE;
-    } else if (strcmp(type, "BLOBMSG_TYPE_ARRAY") == 0) {
-        return BLOBMSG_TYPE_ARRAY;
-    } else if (strcmp(type, "BLOBMSG_TYPE_UNSPEC") == 0) {
-        return BLOBMSG_TYPE_UNSPEC;
-    } else {
-        return BLOBMSG_TYPE_UNSPEC;
+static int qos_value(cJSON *qos, int def) {
+    if (!cJSON_IsNumber(qos))
+        return def;
+    int v = (int)cJSON_GetNumberValue(qos);
+    if (v < 0 || v > 2) {
+        MG_ERROR(("invalid qos: %d, use default: %d", v, def));
+        return def;
     }
+    return v;
 }
 
 /**
@@ -178,14 +456,22 @@ static int blogmsg_type(const char *type) {
  * 1. 解析JSON中的方法定义
  * 2. 创建ubus_method结构
  * 3. 设置方法的处理函数和参数策略
+ * 4. 读取方法的发布qos, 未配置时使用对象qos
  */
 static int add_methods(struct ubus_object *obj, cJSON *method) {
     int n_methods = 0;
     size_t n_ubus_methods = cJSON_GetArraySize(method);
+    struct ubus_object_ext *obj_ext = container_of(obj, struct ubus_object_ext, obj);
 
     struct ubus_method *ubus_methods = calloc(n_ubus_methods, sizeof(struct ubus_method));
     if (!ubus_methods)
         return -ENOMEM;
+
+    obj_ext->method_qos = calloc(n_ubus_methods, sizeof(uint8_t));
+    if (!obj_ext->method_qos) {
+        free(ubus_methods);
+        return -ENOMEM;
+    }
     
     cJSON *item = NULL;
     cJSON_ArrayForEach(item, method) {
@@ -219,8 +505,9 @@ static int add_methods(struct ubus_object *obj, cJSON *method) {
             .mask = 0,
             .tags = 0,
         };
+        obj_ext->method_qos[n_methods] = qos_value(cJSON_GetObjectItem(item, "qos"), obj_ext->qos);
+        MG_INFO(("add ubus object: %s, method: %s, param size: %d, qos: %d", obj->name, m.name, m.n_policy, obj_ext->method_qos[n_methods]));
         UBUS_METHOD_ADD(ubus_methods, n_methods, m);
-        MG_INFO(("add ubus object: %s, method: %s, param size: %d", obj->name, m.name, m.n_policy));
     }
 
     obj->methods = ubus_methods;
@@ -233,6 +520,7 @@ static int add_methods(struct ubus_object *obj, cJSON *method) {
  * @brief 添加ubus对象
  * @param handle 程序句柄
  * @param objname 对象名称
+ * @param qos 对象默认发布qos
  * @param add_methods 添加方法的回调函数
  * @param method JSON格式的方法定义
  * @return 0表示成功,其他值表示失败
@@ -242,7 +530,7 @@ static int add_methods(struct ubus_object *obj, cJSON *method) {
  * 2. 调用add_methods添加方法
  * 3. 向ubus注册对象
  */
-static int add_object(void *handle, const char *objname, int (*add_methods)(struct ubus_object *o, cJSON *method), cJSON *method) {
+static int add_object(void *handle, const char *objname, int qos, int (*add_methods)(struct ubus_object *o, cJSON *method), cJSON *method) {
     struct ubus_object_ext *obj_ext = NULL;
     struct ubus_object *obj = NULL;
     struct ubus_object_type *obj_type = NULL;
@@ -254,6 +542,7 @@ static int add_object(void *handle, const char *objname, int (*add_methods)(stru
         return -ENOMEM;
 
     obj_ext->priv = handle;
+    obj_ext->qos = qos;
     obj = &obj_ext->obj;
 
     obj_type = calloc(1, sizeof(struct ubus_object_type));
@@ -300,7 +589,8 @@ static void add_objects(void *handle) {
                 cJSON *object = cJSON_GetObjectItem(item, "object");
                 cJSON *method = cJSON_GetObjectItem(item, "method");
                 if (object && cJSON_IsString(object) && method && cJSON_IsArray(method)) {
-                    add_object(handle, cJSON_GetStringValue(object), add_methods, method);
+                    int qos = qos_value(cJSON_GetObjectItem(item, "qos"), MQTT_QOS);
+                    add_object(handle, cJSON_GetStringValue(object), qos, add_methods, method);
                 } else {
                     MG_ERROR(("config file %s format is wrong", priv->cfg.opts->ubus_obj_cfg_file));
                 }
@@ -334,19 +624,37 @@ static void start_thread(void *(*f)(void *), void *p) {
 #endif
 }
 
-void timer_mqtt_fn(void *arg);
 static void *mgr_thread(void *param) {
     struct ubusd_private *priv = (struct ubusd_private *)param;
-    int timer_opts = MG_TIMER_REPEAT | MG_TIMER_RUN_NOW;
 
     mg_mgr_init(&priv->mgr);
     priv->mgr.userdata = priv;
-    mg_timer_add(&priv->mgr, 2000, timer_opts, timer_mqtt_fn, &priv->mgr);
-    while (priv->signo == 0) mg_mgr_poll(&priv->mgr, 10);  // Event loop, 10ms timeout
+    priv->transport->start(priv);
+    while (priv->signo == 0) priv->transport->poll(priv);  // Event loop, 10ms timeout
+
+    if (priv->transport->stop)
+        priv->transport->stop(priv);
+    __sync_synchronize();
+    priv->mgr_stopped = 1;
 
     return NULL;
 }
 
+/**
+ * @brief 根据名称查找上游传输层
+ * @param name 传输名称
+ * @return 传输层接口, 未找到返回NULL
+ */
+static struct ubusd_transport *find_transport(const char *name) {
+    static struct ubusd_transport *transports[] = { &mqtt_transport, &ipc_transport };
+
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        if (strcmp(transports[i]->name, name) == 0)
+            return transports[i];
+    }
+    return NULL;
+}
+
 /**
  * @brief 初始化iot-ubusd服务
  * @param priv 返回程序私有数据指针
@@ -354,10 +662,12 @@ static void *mgr_thread(void *param) {
  * @return 0表示成功,其他值表示失败
  * 
  * 该函数负责:
- * 1. 初始化信号处理
- * 2. 创建程序私有数据结构
- * 3. 连接ubus
- * 4. 加载并注册ubus对象
+ * 1. 创建程序私有数据结构
+ * 2. 选择上游传输层
+ * 3. 初始化信号处理
+ * 4. 连接ubus
+ * 5. 加载并注册ubus对象
+ * 6. 启动ubus调用方统计定时器
  */
 int ubusd_init(void **priv, void *opts) {
 
@@ -369,18 +679,34 @@ int ubusd_init(void **priv, void *opts) {
     if (!p)
         return -1;
 
+    p->cfg.opts = opts;
+    mg_log_set(p->cfg.opts->debug_level);
+    p->fs = &mg_fs_posix;
+
+    p->transport = find_transport(p->cfg.opts->transport);
+    if (!p->transport) {
+        MG_ERROR(("unknown transport: %s", p->cfg.opts->transport));
+        free(p);
+        return -1;
+    }
+
     s_signo = &p->signo;
     signal(SIGINT, signal_handler);   // Setup signal handlers - exist event
     signal(SIGTERM, signal_handler);  // manager loop on SIGINT and SIGTERM
 
-    p->cfg.opts = opts;
-    mg_log_set(p->cfg.opts->debug_level);
-    p->fs = &mg_fs_posix;
+    p->capture.fd = -1;
+    if (p->cfg.opts->capture_file)
+        ubusd_capture_open(&p->capture, p->cfg.opts->capture_file, (size_t)p->cfg.opts->capture_max_size);
 
     uloop_init();
     ctx = ubus_connect(NULL);
     if (!ctx) {
         MG_ERROR(("failed to connect to ubus"));
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        s_signo = NULL;
+        ubusd_capture_close(&p->capture);
+        free(p);
         return -1;
     }
 
@@ -390,6 +716,14 @@ int ubusd_init(void **priv, void *opts) {
     // add ubus objects
     add_objects(p);
 
+    // report ubus peer counters
+    p->peer_overflow.tokens = (int64_t)p->cfg.opts->peer_burst * 1000;
+    p->peer_overflow.refill = mg_millis();
+
+    s_peer_stats.priv = p;
+    s_peer_stats.timeout.cb = peer_stats_cb;
+    uloop_timeout_set(&s_peer_stats.timeout, PEER_STATS_INTERVAL);
+
     // start mgr thread
     start_thread(mgr_thread, p);
 
@@ -415,14 +749,21 @@ void ubusd_run() {
  * 该函数负责:
  * 1. 释放ubus上下文
  * 2. 释放JSON配置对象
- * 3. 释放程序私有数据
+ * 3. 关闭抓包文件
+ * 4. 释放程序私有数据
  */
 void ubusd_exit(void *handle) {
     struct ubusd_private *priv = (struct ubusd_private *)handle;
+
+    // wait for mgr thread to release transport resources, at most 1S
+    for (int i = 0; i < 100 && !priv->mgr_stopped; i++)
+        usleep(10000);
+
     ubus_free(priv->ubus_ctx);
     uloop_done();
     if (priv->cfg.ubus_object_json)
         cJSON_Delete(priv->cfg.ubus_object_json);
+    ubusd_capture_close(&priv->capture);
 
     free(handle);
 }
@@ -14,12 +14,24 @@
 struct ubusd_option {
     const char *ubus_obj_cfg_file;    /**< ubus对象配置文件路径 */
 
+    const char *transport;               //上游传输方式, mqtt或unix
+    const char *ipc_path;                //unix传输的iot-rpcd套接字路径
+
     const char *mqtt_serve_address;      //mqtt 服务端口
     int mqtt_keepalive;                  //mqtt 保活间隔
+    int mqtt_sub_qos;                    //mqtt 响应订阅qos
 
     const char *module;
     const char *func;
 
+    int peer_rate;                       //每个ubus调用方每秒允许的请求数, 0表示不限制
+    int peer_burst;                      //每个调用方允许的突发请求数
+
+    int compress_threshold;              //超过该长度的请求压缩后发送, 0表示不压缩
+
+    const char *capture_file;            //ubus调用抓包文件, NULL表示不抓包
+    int capture_max_size;                //抓包文件最大长度, 超过后轮转为.1文件, 0表示不限制
+
     int debug_level;                  /**< 调试日志级别(0-4) */
 
 };
@@ -32,6 +44,53 @@ struct ubusd_config {
     void *ubus_object_json;       /**< 解析后的JSON配置对象,退出时需要释放 */
 };
 
+#define UBUSD_PEER_MAX 32    /**< 同时跟踪的ubus调用方数量 */
+
+/**
+ * @brief ubus调用方(req->peer)的令牌桶和统计计数
+ */
+struct ubusd_peer {
+    uint32_t id;                  /**< ubus peer id, 0表示空闲 */
+    uint64_t active;              /**< 最近一次请求时间 */
+    int64_t tokens;               /**< 剩余令牌, 单位1/1000请求 */
+    uint64_t refill;              /**< 上次补充令牌时间 */
+    uint32_t accepted;            /**< 本统计周期内接受的请求数 */
+    uint32_t rejected;            /**< 本统计周期内拒绝的请求数 */
+    uint64_t total_accepted;      /**< 累计接受的请求数 */
+    uint64_t total_rejected;      /**< 累计拒绝的请求数 */
+};
+
+/**
+ * @brief ubus调用抓包文件
+ */
+struct ubusd_capture {
+    int fd;                       /**< 文件描述符, -1表示不抓包 */
+    const char *path;             /**< 文件路径 */
+    size_t max_size;              /**< 文件最大长度, 0表示不限制 */
+    size_t size;                  /**< 当前文件长度 */
+};
+
+struct ubusd_private;
+
+/**
+ * @brief 上游传输层接口, 运行在mgr线程中
+ *
+ * 传输层负责将request槽中的请求发送给iot-rpcd, 并将收到的响应放入response槽。
+ * 传输层用ubusd_request_claim取得请求, ubus_handler超时后收回尚未取走的请求,
+ * 两者互斥, 请求最多发送一次: 无法发送或连接断开时未发送完的请求直接丢弃, 不重发,
+ * 由ubus_handler的10秒超时返回失败。
+ * 响应需要带上对应的请求id, ubus_handler丢弃与当前请求不匹配的迟到响应
+ */
+struct ubusd_transport {
+    const char *name;                              /**< 传输名称, 对应-t参数 */
+    void (*start)(struct ubusd_private *priv);     /**< 启动传输, 进入事件循环前调用 */
+    void (*poll)(struct ubusd_private *priv);      /**< 单次事件轮询, 最长阻塞约10ms */
+    void (*stop)(struct ubusd_private *priv);      /**< 退出事件循环后释放传输层资源, 可以为NULL */
+};
+
+extern struct ubusd_transport mqtt_transport;     /**< 经本地mqtt服务转发, 默认 */
+extern struct ubusd_transport ipc_transport;      /**< 经unix套接字直连iot-rpcd */
+
 /**
  * @brief 程序私有数据结构
  */
@@ -39,6 +98,9 @@ struct ubusd_private {
     struct ubusd_config cfg;      /**< 配置信息 */
     void *ubus_ctx;              /**< ubus上下文 */
 
+    struct ubusd_transport *transport; /**< 上游传输层 */
+    void *transport_data;              /**< 传输层私有数据 */
+
     struct mg_mgr mgr;
     struct mg_connection *mqtt_conn;
     uint64_t ping_active;
@@ -48,12 +110,113 @@ struct ubusd_private {
 
     int signo;                  /**< 退出信号 */
 
-    volatile int request_full;   /**< 请求缓冲区是否已满 */
+    struct ubusd_capture capture; /**< ubus调用抓包文件 */
+
+    struct ubusd_peer peers[UBUSD_PEER_MAX]; /**< ubus调用方限流表, 仅在ubus线程访问 */
+    struct ubusd_peer peer_overflow; /**< 跟踪表中没有可淘汰项时, 新调用方共用的令牌桶 */
+
+    volatile int mgr_stopped;    /**< mgr线程是否已退出并释放传输层资源 */
+
+    volatile int request_full;   /**< 请求缓冲区状态, 0空闲, 1待发送, 2传输层发送中 */
     volatile int response_full;  /**< 响应缓冲区是否已满 */
+    uint32_t request_id;         /**< 当前请求id */
+    uint32_t response_id;        /**< 响应对应的请求id, 由传输层设置 */
+    int request_qos;   /**< 请求发布qos */
+    int request_compressed;  /**< 请求是否为zlib压缩消息, 由传输层在信封中标记 */
     char *request;     /**< 请求 */
-    char *response;    /**< 响应 */
+    size_t request_len;  /**< 请求长度, 压缩请求不是字符串 */
+    int response_compressed; /**< 响应是否为zlib压缩消息, 由传输层按信封标记设置 */
+    char *response;    /**< 响应, 以'\0'结尾 */
+    size_t response_len; /**< 响应长度, 压缩响应不是字符串 */
 };
 
+struct blob_buf;
+struct cJSON;
+
+/**
+ * @brief 构造调用lua回调脚本的iot-rpcd请求
+ * @param opts 配置选项
+ * @param object 对象名
+ * @param method 方法名
+ * @param args JSON格式的调用参数
+ * @return 请求JSON对象, 需要cJSON_Delete释放
+ */
+struct cJSON *build_call_request(struct ubusd_option *opts, const char *object, const char *method, const char *args);
+
+/**
+ * @brief 将字符串类型转换为blobmsg类型
+ * @param type 类型字符串
+ * @return blobmsg类型枚举值
+ */
+int blogmsg_type(const char *type);
+
+/**
+ * @brief 传输层取得request槽中的请求, 与超时收回互斥
+ * @param priv 程序私有数据
+ * @return 1表示取得, 之后由传输层读取请求并调用ubusd_request_release
+ */
+int ubusd_request_claim(struct ubusd_private *priv);
+
+/**
+ * @brief 传输层处理完请求后释放request槽
+ * @param priv 程序私有数据
+ */
+void ubusd_request_release(struct ubusd_private *priv);
+
+/**
+ * @brief 压缩消息
+ * @param data 消息内容
+ * @param len 消息长度
+ * @param level zlib压缩等级
+ * @param out_len 返回压缩后长度
+ * @return 压缩后的消息, 需要free; 失败或压缩后不更小时返回NULL
+ */
+char *ubusd_deflate(const char *data, size_t len, int level, size_t *out_len);
+
+/**
+ * @brief 解压JSON消息并直接写入blob
+ * @param bb blob缓冲区
+ * @param data 压缩消息
+ * @param len 压缩消息长度
+ * @param plain_len 返回解压后长度, 可以为NULL
+ * @return 0表示成功, -1表示失败
+ */
+int ubusd_inflate_json(struct blob_buf *bb, const char *data, size_t len, size_t *plain_len);
+
+/**
+ * @brief 打开抓包文件, 新文件写入文件头
+ * @param cap 抓包文件
+ * @param path 抓包文件路径
+ * @param max_size 文件最大长度, 超过后轮转为path.1, 0表示不限制
+ * @return 0表示成功, -1表示失败
+ */
+int ubusd_capture_open(struct ubusd_capture *cap, const char *path, size_t max_size);
+
+/**
+ * @brief 关闭抓包文件
+ * @param cap 抓包文件
+ */
+void ubusd_capture_close(struct ubusd_capture *cap);
+
+/**
+ * @brief 获取单调时钟, 用于计算调用耗时
+ * @return 微秒
+ */
+uint64_t ubusd_capture_clock(void);
+
+/**
+ * @brief 追加一条调用记录
+ * @param cap 抓包文件
+ * @param start 调用开始时间, ubusd_capture_clock返回值
+ * @param object 对象名
+ * @param method 方法名
+ * @param args JSON格式的调用参数, 可以为NULL
+ * @param response_len 响应长度, 压缩响应为解压后的长度
+ * @param limited 调用是否被限流拒绝
+ */
+void ubusd_capture_record(struct ubusd_capture *cap, uint64_t start, const char *object, const char *method,
+                          const char *args, size_t response_len, int limited);
+
 /**
  * @brief 程序主入口函数
  * @param user_options 用户配置选项